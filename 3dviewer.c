@@ -3,40 +3,19 @@
 #include <epoxy/gl.h>
 #include <gtk/gtk.h>
 
+static void open_model(GObject *gl_area, const char *filename);
+static void start_recording(GObject *gl_area, const char *base);
+
+static void close_capture(GtkWidget *gl_area);
+
 static void realize(GtkWidget *gl_area, gpointer data) {
   gtk_gl_area_make_current(GTK_GL_AREA(gl_area));
   if (gtk_gl_area_get_error(GTK_GL_AREA(gl_area)) != NULL) return;
 
   glEnable(GL_DEPTH_CLAMP);
 
-  const char *vertex_shader_source =
-      "#version 330 core\n"
-      "layout(location = 0) in vec3 position;\n"
-      "void main() { gl_Position = vec4(position.x, position.y, position.z, "
-      "1.0); }\0";
-  GLuint vertex_shader;
-  vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-  glShaderSource(vertex_shader, 1, &vertex_shader_source, NULL);
-  glCompileShader(vertex_shader);
-
-  const char *fragment_shader_source =
-      "#version 330 core\n"
-      "out vec4 FragColor;\n"
-      "uniform vec4 vertexColor;"
-      "void main() { FragColor = vertexColor; }\0";
-  GLuint fragment_shader;
-  fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(fragment_shader, 1, &fragment_shader_source, NULL);
-  glCompileShader(fragment_shader);
-
-  unsigned int shader_program;
-  shader_program = glCreateProgram();
-  glAttachShader(shader_program, vertex_shader);
-  glAttachShader(shader_program, fragment_shader);
-  glLinkProgram(shader_program);
-
-  glDeleteShader(vertex_shader);
-  glDeleteShader(fragment_shader);
+  unsigned int shader_program = load_shader_program("wireframe");
+  unsigned int shaded_program = load_shader_program("shaded");
 
   GLuint vao, vbo, ebo;
   glGenVertexArrays(1, &vao);
@@ -50,7 +29,48 @@ static void realize(GtkWidget *gl_area, gpointer data) {
   g_object_set_data(G_OBJECT(gl_area), "ebo", GUINT_TO_POINTER(ebo));
   g_object_set_data(G_OBJECT(gl_area), "shader-program",
                     GUINT_TO_POINTER(shader_program));
+
+  // The shaded pass shares the vertex buffer and adds normals and triangles.
+  GLuint shaded_vao, nbo, tbo;
+  glGenVertexArrays(1, &shaded_vao);
+  glBindVertexArray(shaded_vao);
+  glGenBuffers(1, &nbo);
+  glGenBuffers(1, &tbo);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, tbo);
+  g_object_set_data(G_OBJECT(gl_area), "shaded-vao",
+                    GUINT_TO_POINTER(shaded_vao));
+  g_object_set_data(G_OBJECT(gl_area), "nbo", GUINT_TO_POINTER(nbo));
+  g_object_set_data(G_OBJECT(gl_area), "tbo", GUINT_TO_POINTER(tbo));
+  g_object_set_data(G_OBJECT(gl_area), "shaded-program",
+                    GUINT_TO_POINTER(shaded_program));
+  glBindVertexArray(0);
+
+  // The section outline has its own float vertices, drawn as lines.
+  GLuint section_vao, section_vbo;
+  glGenVertexArrays(1, &section_vao);
+  glBindVertexArray(section_vao);
+  glGenBuffers(1, &section_vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, section_vbo);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float),
+                        (void *)0);
+  glEnableVertexAttribArray(0);
+  g_object_set_data(G_OBJECT(gl_area), "section-vao",
+                    GUINT_TO_POINTER(section_vao));
+  g_object_set_data(G_OBJECT(gl_area), "section-vbo",
+                    GUINT_TO_POINTER(section_vbo));
   glBindVertexArray(0);
+
+  CaptureRing *capture = g_object_get_data(G_OBJECT(gl_area), "capture");
+  glGenBuffers(CAPTURE_PBO_COUNT, capture->pbo);
+  if (capture_open(&capture->queue) != OK) {
+    fprintf(stderr, "Could not start the capture encoder\n");
+  }
+
+  const char *pending = g_object_get_data(G_OBJECT(gl_area), "pending-model");
+  if (pending) {
+    open_model(G_OBJECT(gl_area), pending);
+    g_object_set_data(G_OBJECT(gl_area), "pending-model", NULL);
+  }
 }
 
 static void unrealize(GtkWidget *gl_area) {
@@ -68,15 +88,91 @@ static void unrealize(GtkWidget *gl_area) {
       GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(gl_area), "ebo"));
   unsigned int shader_program =
       GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(gl_area), "shader-program"));
-
+  unsigned int shaded_vao =
+      GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(gl_area), "shaded-vao"));
+  unsigned int nbo =
+      GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(gl_area), "nbo"));
+  unsigned int tbo =
+      GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(gl_area), "tbo"));
+  unsigned int shaded_program =
+      GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(gl_area), "shaded-program"));
+  unsigned int section_vao =
+      GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(gl_area), "section-vao"));
+  unsigned int section_vbo =
+      GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(gl_area), "section-vbo"));
+
+  close_capture(gl_area);
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
   glDeleteBuffers(1, &ebo);
+  glDeleteBuffers(1, &tbo);
   glBindBuffer(GL_ARRAY_BUFFER, 0);
   glDeleteBuffers(1, &vbo);
+  glDeleteBuffers(1, &nbo);
   glDeleteVertexArrays(1, &vao);
+  glDeleteVertexArrays(1, &shaded_vao);
+  glDeleteBuffers(1, &section_vbo);
+  glDeleteVertexArrays(1, &section_vao);
   glDeleteProgram(shader_program);
+  glDeleteProgram(shaded_program);
   Model1 *model = g_object_get_data(G_OBJECT(gl_area), "model");
   free_model(model);
+  free_model(g_object_get_data(G_OBJECT(gl_area), "source"));
+  free_topology(g_object_get_data(G_OBJECT(gl_area), "topology"));
+  free_point_cloud(g_object_get_data(G_OBJECT(gl_area), "points"));
+  Section *section = g_object_get_data(G_OBJECT(gl_area), "section");
+  free_section_index(&section->index);
+  free_section_lines(&section->lines);
+  section->index_dirty = 1;
+  g_object_set_data(G_OBJECT(gl_area), "monitor", NULL);
+  guint timeout =
+      GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(gl_area), "reload-timeout"));
+  if (timeout) g_source_remove(timeout);
+  g_object_set_data(G_OBJECT(gl_area), "reload-timeout", NULL);
+  size_t *gpu_bytes = g_object_get_data(G_OBJECT(gl_area), "gpu-bytes");
+  memory_track(MEMORY_GPU, -(long long)*gpu_bytes);
+  *gpu_bytes = 0;
+}
+
+// The chunk bounds follow the vertices, so any change to the geometry
+// rebuilds them before the next section.
+static void mark_section_dirty(GObject *gl_area) {
+  Section *section = g_object_get_data(gl_area, "section");
+  section->index_dirty = 1;
+  section->lines_dirty = 1;
+}
+
+// Every user transform is also folded into "transform", so a reloaded file
+// can be brought to the same place as the model on screen.
+static void apply_transform(GObject *gl_area, Matrix matrix) {
+  Model1 *model = g_object_get_data(gl_area, "model");
+  Matrix *transform = g_object_get_data(gl_area, "transform");
+  unsigned int *generation =
+      g_object_get_data(gl_area, "transform-generation");
+
+  modify_model(model, matrix);
+  *transform = mult_matrices(matrix, *transform);
+  (*generation)++;
+  // Zoom limits follow the size of the model even before the next fit.
+  BoundingSphere *sphere = g_object_get_data(gl_area, "sphere");
+  Camera *camera = g_object_get_data(gl_area, "camera");
+  transform_sphere(sphere, matrix);
+  if (sphere->radius > 0) camera->radius = sphere->radius;
+  g_object_set_data(gl_area, "geometry-dirty", GINT_TO_POINTER(1));
+  mark_section_dirty(gl_area);
+}
+
+static double view_aspect(GtkWidget *gl_area) {
+  int width = gtk_widget_get_width(gl_area);
+  int height = gtk_widget_get_height(gl_area);
+  return height > 0 ? (double)width / height : 1.0;
+}
+
+// The cached sphere makes a refit O(1) however the model was turned.
+static void clicked_fit(GtkWidget *button, GtkWidget *gl_area) {
+  fit_camera(g_object_get_data(G_OBJECT(gl_area), "camera"),
+             g_object_get_data(G_OBJECT(gl_area), "sphere"),
+             view_aspect(gl_area));
+  gtk_widget_queue_draw(gl_area);
 }
 
 static void clicked(GtkWidget *button, gpointer gl_area) {
@@ -90,26 +186,13 @@ static void clicked(GtkWidget *button, gpointer gl_area) {
   spin = GTK_SPIN_BUTTON(g_object_get_data(G_OBJECT(button), "z"));
   double z = gtk_spin_button_get_value(spin);
 
-  Model1 *model = (g_object_get_data(G_OBJECT(gl_area), "model"));
-  Matrix matrix;
-
   const char *name = gtk_button_get_label(GTK_BUTTON(button));
   if (strstr(name, "Move") && (x || y || z) != 0) {
-    Matrix matrix = create_translation_matrix(x, y, z);
-    modify_model(model, matrix);
+    apply_transform(G_OBJECT(gl_area), create_translation_matrix(x, y, z));
   } else {
-    if (x) {
-      matrix = create_rotation_matrix_x(x);
-      modify_model(model, matrix);
-    }
-    if (y) {
-      matrix = create_rotation_matrix_y(y);
-      modify_model(model, matrix);
-    }
-    if (z) {
-      matrix = create_rotation_matrix_z(z);
-      modify_model(model, matrix);
-    }
+    if (x) apply_transform(G_OBJECT(gl_area), create_rotation_matrix_x(x));
+    if (y) apply_transform(G_OBJECT(gl_area), create_rotation_matrix_y(y));
+    if (z) apply_transform(G_OBJECT(gl_area), create_rotation_matrix_z(z));
   }
 
   gtk_widget_queue_draw(GTK_WIDGET(gl_area));
@@ -121,21 +204,169 @@ static void clicked_scale(GtkWidget *button, gpointer gl_area) {
   double x = gtk_spin_button_get_value(spin_scale);
 
   if (x) {
-    Model1 *model = (g_object_get_data(G_OBJECT(gl_area), "model"));
-    Matrix matrix;
-    matrix = create_scale_matrix(x);
-    modify_model(model, matrix);
+    apply_transform(G_OBJECT(gl_area), create_scale_matrix(x));
   }
 
   gtk_widget_queue_draw(GTK_WIDGET(gl_area));
 }
 
+// Filled triangles lit by a light at the camera; both sides are lit the same
+// way because OBJ files rarely agree on the winding.
+static void draw_shaded(GtkWidget *gl_area, Model1 *model, float mvp[16],
+                        float view[16], float clip[4]) {
+  unsigned int shaded_program =
+      GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(gl_area), "shaded-program"));
+  unsigned int shaded_vao =
+      GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(gl_area), "shaded-vao"));
+  glUseProgram(shaded_program);
+  glUniformMatrix4fv(glGetUniformLocation(shaded_program, "mvp"), 1, GL_TRUE,
+                     mvp);
+  glUniformMatrix4fv(glGetUniformLocation(shaded_program, "view"), 1, GL_TRUE,
+                     view);
+  glUniform4f(glGetUniformLocation(shaded_program, "surfaceColor"),
+              SURFACE_COLOR);
+  glUniform4fv(glGetUniformLocation(shaded_program, "clipPlane"), 1, clip);
+
+  glBindVertexArray(shaded_vao);
+  glEnable(GL_POLYGON_OFFSET_FILL);
+  glPolygonOffset(1.0f, 1.0f);
+  glDrawElements(GL_TRIANGLES, model->triangle_count * 3, GL_UNSIGNED_INT,
+                 (void *)0);
+  glDisable(GL_POLYGON_OFFSET_FILL);
+  glBindVertexArray(
+      GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(gl_area), "vao")));
+}
+
+// Point clouds draw a prefix of the level-ordered indices in the element
+// buffer: the finer the pixels are relative to the model, the longer it is.
+static void draw_points(GtkWidget *gl_area, Settings *settings,
+                        PointCloud *points, GLint vertex_color_location) {
+  Camera *camera = g_object_get_data(G_OBJECT(gl_area), "camera");
+  Matrix *transform = g_object_get_data(G_OBJECT(gl_area), "transform");
+  int height = gtk_widget_get_height(gl_area);
+  double scale = transform_scale(*transform);
+  double pixel_size = height > 0 && scale > 0
+                          ? 2 * camera_half_height(camera) / height / scale
+                          : 0;
+  unsigned int count =
+      point_cloud_draw_count(points, pixel_size, POINT_DRAW_BUDGET);
+
+  if (settings->edge_display_method == CIRCLE_EDGE)
+    glEnable(GL_POINT_SMOOTH);
+  else
+    glDisable(GL_POINT_SMOOTH);
+  glPointSize(settings->vertex_size);
+  ColorRGBA *color = &(settings->vertex_color);
+  glUniform4f(vertex_color_location, color->red, color->green, color->blue,
+              color->alpha);
+  glDrawElements(GL_POINTS, count, GL_UNSIGNED_INT, (void *)0);
+}
+
+// update_section runs first in every frame, so the plane is current here.
+static void section_clip_plane(Section *section, float clip[4]) {
+  for (int i = 0; i < 4; i++) {
+    clip[i] = section->enabled ? (float)section->plane[i] : i == 3;
+  }
+}
+
+// Point clouds and face-less models have no chunks; the slider then spans
+// the cached bounding sphere, which follows the model like the chunks do.
+static void section_range(GtkWidget *gl_area, Section *section,
+                          double extent[2]) {
+  BoundingSphere *sphere = g_object_get_data(G_OBJECT(gl_area), "sphere");
+
+  if (section->index.chunk_count > 0) {
+    section_extent(&section->index, section->axis, extent);
+  } else {
+    extent[0] = sphere->center[section->axis] - sphere->radius;
+    extent[1] = sphere->center[section->axis] + sphere->radius;
+  }
+}
+
+// Slider moves only mark the section stale; it is recomputed at most once
+// per frame, from the chunks the plane crosses.
+static void update_section(GtkWidget *gl_area, Model1 *model) {
+  Section *section = g_object_get_data(G_OBJECT(gl_area), "section");
+
+  if (section->enabled && (section->index_dirty || section->lines_dirty)) {
+    int error_code = OK;
+    if (section->index_dirty) {
+      error_code = build_section_index(model, &section->index);
+    }
+
+    double extent[2];
+    section_range(gl_area, section, extent);
+    section_plane(section->axis,
+                  extent[0] + (extent[1] - extent[0]) * section->position,
+                  section->plane);
+    if (error_code == OK) {
+      compute_section(model, &section->index, section->plane,
+                      &section->lines);
+    } else {
+      section->lines.segment_count = 0;
+    }
+    section->index_dirty = 0;
+    section->lines_dirty = 0;
+
+    glBindBuffer(GL_ARRAY_BUFFER, GPOINTER_TO_UINT(g_object_get_data(
+                                      G_OBJECT(gl_area), "section-vbo")));
+    glBufferData(GL_ARRAY_BUFFER,
+                 sizeof(float) * 6 * section->lines.segment_count,
+                 section->lines.points, GL_DYNAMIC_DRAW);
+  }
+}
+
+// The outline lies on the plane itself, so it is drawn unclipped.
+static void draw_section(GtkWidget *gl_area, Section *section,
+                         GLint vertex_color_location) {
+  glDisable(GL_CLIP_DISTANCE0);
+  glBindVertexArray(
+      GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(gl_area), "section-vao")));
+  glUniform4f(vertex_color_location, SECTION_COLOR);
+  glDrawArrays(GL_LINES, 0, 2 * section->lines.segment_count);
+  glBindVertexArray(
+      GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(gl_area), "vao")));
+}
+
 void draw(GtkWidget *gl_area, GdkGLContext *context, Settings *settings,
           Model1 *model) {
+  Camera *camera = g_object_get_data(G_OBJECT(gl_area), "camera");
+  double aspect = view_aspect(gl_area);
+  fit_clip_planes(camera, g_object_get_data(G_OBJECT(gl_area), "sphere"));
+  Matrix view = create_view_matrix(camera);
+  Matrix mvp = mult_matrices(
+      create_projection_matrix(camera, settings->projection, aspect), view);
+  float mvp_data[16];
+  float view_data[16];
+  matrix_to_float(mvp, mvp_data);
+  matrix_to_float(view, view_data);
+
+  Section *section = g_object_get_data(G_OBJECT(gl_area), "section");
+  float clip[4];
+  section_clip_plane(section, clip);
+  if (section->enabled)
+    glEnable(GL_CLIP_DISTANCE0);
+  else
+    glDisable(GL_CLIP_DISTANCE0);
+
+  PointCloud *points = g_object_get_data(G_OBJECT(gl_area), "points");
+  gboolean shaded = settings->display_mode != DISPLAY_WIREFRAME &&
+                    model->triangle_count > 0 && points->order == NULL;
+  if (shaded) {
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LEQUAL);
+    draw_shaded(gl_area, model, mvp_data, view_data, clip);
+  } else {
+    glDisable(GL_DEPTH_TEST);
+  }
+
   glEnableVertexAttribArray(0);
   unsigned int shader_program =
       GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(gl_area), "shader-program"));
   glUseProgram(shader_program);
+  glUniformMatrix4fv(glGetUniformLocation(shader_program, "mvp"), 1, GL_TRUE,
+                     mvp_data);
+  glUniform4fv(glGetUniformLocation(shader_program, "clipPlane"), 1, clip);
 
   GLint vertex_color_location =
       glGetUniformLocation(shader_program, "vertexColor");
@@ -143,13 +374,17 @@ void draw(GtkWidget *gl_area, GdkGLContext *context, Settings *settings,
   glUniform4f(vertex_color_location, color->red, color->green, color->blue,
               color->alpha);
 
-  for (int i = 0, offset = 0; i < model->polygon_count; i++) {
-    int count = model->num_vertices_in_polygon[i];
-    void *ptr = (void *)(offset * sizeof(unsigned int));
-    glDrawElementsBaseVertex(GL_LINE_LOOP, count, GL_UNSIGNED_INT, ptr, -1);
-    offset += model->num_vertices_in_polygon[i];
+  if (points->order != NULL) {
+    draw_points(gl_area, settings, points, vertex_color_location);
+  } else if (!shaded || settings->display_mode == DISPLAY_SHADED_WIREFRAME) {
+    // One draw for all polygons: the index ends every loop with a restart.
+    glEnable(GL_PRIMITIVE_RESTART);
+    glPrimitiveRestartIndex(LINE_LOOP_RESTART);
+    glDrawElements(GL_LINE_LOOP, line_loop_count(model), GL_UNSIGNED_INT,
+                   (void *)0);
+    glDisable(GL_PRIMITIVE_RESTART);
   }
-  if (settings->edge_display_method != NONE_EDGE) {
+  if (settings->edge_display_method != NONE_EDGE && points->order == NULL) {
     if (settings->edge_display_method == CIRCLE_EDGE)
       glEnable(GL_POINT_SMOOTH);
     else
@@ -160,10 +395,338 @@ void draw(GtkWidget *gl_area, GdkGLContext *context, Settings *settings,
                 color->alpha);
     glDrawArrays(GL_POINTS, 0, model->vertex_count);
   }
+  if (section->enabled) draw_section(gl_area, section, vertex_color_location);
   glDisableVertexAttribArray(0);
 }
 
+// Vertices go to the GPU as doubles unless the memory budget asked for the
+// float fallback; floats are converted in bounded slices, never all at once.
+static void upload_vertex_range(Model1 *model, unsigned int first,
+                                unsigned int count) {
+  if (model->float_vertices) {
+    float slice[VERTEX_UPLOAD_SLICE * 3];
+    for (unsigned int start = first; start < first + count;
+         start += VERTEX_UPLOAD_SLICE) {
+      unsigned int size = first + count - start;
+      if (size > VERTEX_UPLOAD_SLICE) size = VERTEX_UPLOAD_SLICE;
+      for (unsigned int i = 0; i < size * 3; i++) {
+        slice[i] = (float)model->vertices[start * 3 + i];
+      }
+      glBufferSubData(GL_ARRAY_BUFFER, start * 3 * sizeof(float),
+                      size * 3 * sizeof(float), slice);
+    }
+  } else {
+    glBufferSubData(GL_ARRAY_BUFFER, first * 3 * sizeof(model->vertices[0]),
+                    count * 3 * sizeof(model->vertices[0]),
+                    model->vertices + first * 3);
+  }
+}
+
+static void upload_vertices(Model1 *model) {
+  upload_vertex_range(model, 0, model->vertex_count);
+}
+
+// The wireframe index is written straight into the mapped element buffer;
+// a driver that refuses the mapping gets a copy built in main memory.
+static void upload_line_loop_span(Model1 *model, unsigned int first,
+                                  unsigned int last) {
+  unsigned int start = line_loop_position(model, first);
+  size_t offset = start * sizeof(unsigned int);
+  size_t size =
+      (line_loop_position(model, last - 1) - start + 1) * sizeof(unsigned int);
+  unsigned int *indices =
+      glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, offset, size,
+                       GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+
+  if (indices != NULL) {
+    build_line_loop_span(model, first, last, indices);
+    glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+  } else {
+    indices = memory_allocation(size, "line loop index");
+    if (indices != NULL) {
+      build_line_loop_span(model, first, last, indices);
+      glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, offset, size, indices);
+      free(indices);
+    }
+  }
+}
+
+static void upload_line_loops(Model1 *model) {
+  size_t size = line_loop_count(model) * sizeof(unsigned int);
+  unsigned int *indices = NULL;
+
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, NULL, GL_STATIC_DRAW);
+  if (size > 0) {
+    indices = glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, size,
+                               GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (indices != NULL) {
+      build_line_loops(model, indices);
+      glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+    } else {
+      indices = memory_allocation(size, "line loop index");
+      if (indices != NULL) {
+        build_line_loops(model, indices);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, size, indices);
+        free(indices);
+      }
+    }
+  }
+}
+
+static void upload_normals(GtkWidget *gl_area, Model1 *model) {
+  unsigned int nbo =
+      GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(gl_area), "nbo"));
+  glBindBuffer(GL_ARRAY_BUFFER, nbo);
+  glBufferSubData(GL_ARRAY_BUFFER, 0,
+                  model->normal_count * 3 * sizeof(model->normals[0]),
+                  model->normals);
+}
+
+static void update_frame_rate(GObject *gl_area, gint64 frame_start) {
+  FrameStats *stats = g_object_get_data(gl_area, "frame-stats");
+  gint64 now = g_get_monotonic_time();
+
+  // A pause in redraws means the view was idle, not that frames were slow.
+  if (now - stats->last_frame > FPS_IDLE_USEC) {
+    stats->window_start = now;
+    stats->frames = 0;
+  }
+  stats->last_frame = now;
+  stats->frames++;
+  stats->frame_ms = (now - frame_start) / 1000.0;
+
+  if (now - stats->window_start >= FPS_WINDOW_USEC) {
+    stats->fps = stats->frames * 1e6 / (now - stats->window_start);
+    stats->window_start = now;
+    stats->frames = 0;
+
+    GtkLabel *label = g_object_get_data(gl_area, "fps");
+    char str_fps[64];
+    sprintf(str_fps, "%.0f FPS (%.2f ms)", stats->fps, stats->frame_ms);
+    gtk_label_set_label(label, str_fps);
+  }
+}
+
+// The first frame that shows the requested model ends the cold start.
+static void report_startup(GObject *gl_area) {
+  gint64 *startup_time = g_object_get_data(gl_area, "startup-time");
+
+  if (*startup_time != 0 && !g_object_get_data(gl_area, "pending-model")) {
+    double startup_ms = (g_get_monotonic_time() - *startup_time) / 1000.0;
+    *startup_time = 0;
+
+    if (g_getenv(STARTUP_BENCH_ENV)) {
+      g_print("Cold start: %.1f ms, memory %.1f MB (peak %.1f MB)\n",
+              startup_ms, memory_current() / MEGABYTE,
+              memory_peak() / MEGABYTE);
+      g_application_quit(g_application_get_default());
+    } else if (g_getenv(CAPTURE_BENCH_ENV)) {
+      start_recording(gl_area, g_getenv(CAPTURE_BENCH_ENV));
+    }
+  }
+}
+
+// Maps a readback into main memory and hands it to the encoder; mapping
+// waits for the GPU if the fence has not signalled yet.
+static void finish_readback(CaptureRing *ring, unsigned int slot) {
+  CaptureFrame *frame = &ring->frame[slot];
+  size_t size = (size_t)frame->width * frame->height * 4;
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, ring->pbo[slot]);
+  const void *mapped =
+      glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+  if (mapped != NULL) {
+    frame->pixels = memory_allocation(size, "captured frame");
+    if (frame->pixels != NULL) memcpy(frame->pixels, mapped, size);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  glDeleteSync(ring->fence[slot]);
+  ring->fence[slot] = NULL;
+
+  if (frame->pixels != NULL) capture_push(&ring->queue, frame);
+}
+
+// Oldest first, and only the readbacks the GPU has already finished.
+static void collect_readbacks(CaptureRing *ring) {
+  gboolean ready = TRUE;
+
+  for (unsigned int i = 0; i < CAPTURE_PBO_COUNT && ready; i++) {
+    unsigned int slot = (ring->next + i) % CAPTURE_PBO_COUNT;
+    if (ring->fence[slot] != NULL) {
+      GLenum status = glClientWaitSync(ring->fence[slot], 0, 0);
+      ready = status == GL_ALREADY_SIGNALED ||
+              status == GL_CONDITION_SATISFIED;
+      if (ready) finish_readback(ring, slot);
+    }
+  }
+}
+
+static gboolean readbacks_pending(CaptureRing *ring) {
+  gboolean pending = FALSE;
+  for (unsigned int i = 0; i < CAPTURE_PBO_COUNT; i++) {
+    if (ring->fence[i] != NULL) pending = TRUE;
+  }
+  return pending;
+}
+
+static void update_capture_status(GObject *gl_area, CaptureStats stats) {
+  GtkLabel *status = g_object_get_data(gl_area, "status");
+  char str_status[256];
+  snprintf(str_status, sizeof(str_status),
+           "Capture: %u written, %u pending, %u dropped, %u failed",
+           stats.written, stats.pending, stats.dropped, stats.failed);
+  gtk_label_set_label(status, str_status);
+}
+
+// The capture bench ends once the turntable is recorded and written.
+static void report_capture(GObject *gl_area, CaptureStats stats) {
+  CaptureRing *ring = g_object_get_data(gl_area, "capture");
+
+  if (g_getenv(CAPTURE_BENCH_ENV) && ring->record_base[0] != '\0') {
+    g_print("Captured %u frames (%u dropped, %u failed) at %.0f FPS\n",
+            stats.written, stats.dropped, stats.failed, ring->record_fps);
+    g_application_quit(g_application_get_default());
+  }
+}
+
+// Readbacks finish a frame or two after they were started, usually with no
+// new render to pick them up, so they are collected from a short timer.
+static gboolean capture_poll(gpointer gl_area) {
+  CaptureRing *ring = g_object_get_data(G_OBJECT(gl_area), "capture");
+  gboolean result = G_SOURCE_CONTINUE;
+
+  gtk_gl_area_make_current(GTK_GL_AREA(gl_area));
+  if (gtk_gl_area_get_error(GTK_GL_AREA(gl_area)) == NULL) {
+    collect_readbacks(ring);
+  }
+  CaptureStats stats = capture_stats(&ring->queue);
+  update_capture_status(G_OBJECT(gl_area), stats);
+
+  if (!readbacks_pending(ring) && stats.pending == 0 &&
+      ring->record_frames == 0) {
+    ring->poll_id = 0;
+    report_capture(G_OBJECT(gl_area), stats);
+    result = G_SOURCE_REMOVE;
+  }
+
+  return result;
+}
+
+static void start_readback(GtkWidget *gl_area, CaptureRing *ring,
+                           const char *filename) {
+  GLint viewport[4];
+  unsigned int slot = ring->next;
+
+  // Only a GPU CAPTURE_PBO_COUNT frames behind makes this wait.
+  if (ring->fence[slot] != NULL) finish_readback(ring, slot);
+
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  size_t size = (size_t)viewport[2] * viewport[3] * 4;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, ring->pbo[slot]);
+  if (ring->capacity[slot] != size) {
+    glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+    memory_track(MEMORY_GPU,
+                 (long long)size - (long long)ring->capacity[slot]);
+    ring->capacity[slot] = size;
+  }
+  glReadPixels(viewport[0], viewport[1], viewport[2], viewport[3], GL_RGBA,
+               GL_UNSIGNED_BYTE, (void *)0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  ring->fence[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  CaptureFrame *frame = &ring->frame[slot];
+  frame->width = viewport[2];
+  frame->height = viewport[3];
+  snprintf(frame->filename, sizeof(frame->filename), "%s", filename);
+  ring->next = (slot + 1) % CAPTURE_PBO_COUNT;
+
+  if (ring->poll_id == 0) {
+    ring->poll_id = g_timeout_add(CAPTURE_POLL_MS, capture_poll, gl_area);
+  }
+}
+
+static void stop_recording(GObject *gl_area) {
+  CaptureRing *ring = g_object_get_data(gl_area, "capture");
+
+  if (ring->tick_id != 0) {
+    gtk_widget_remove_tick_callback(GTK_WIDGET(gl_area), ring->tick_id);
+    ring->tick_id = 0;
+    double seconds = (g_get_monotonic_time() - ring->record_start) / 1e6;
+    ring->record_fps = seconds > 0 ? ring->record_index / seconds : 0;
+  }
+  ring->record_frames = 0;
+  gtk_toggle_button_set_active(g_object_get_data(gl_area, "button-record"),
+                               FALSE);
+}
+
+static void capture_rendered_frame(GtkWidget *gl_area) {
+  CaptureRing *ring = g_object_get_data(G_OBJECT(gl_area), "capture");
+
+  if (ring->screenshot[0] != '\0') {
+    start_readback(gl_area, ring, ring->screenshot);
+    ring->screenshot[0] = '\0';
+  }
+  if (ring->record_index < ring->record_frames) {
+    char filename[CAPTURE_NAME_LENGTH];
+    capture_frame_name(ring->record_base, ring->record_index, filename,
+                       sizeof(filename));
+    start_readback(gl_area, ring, filename);
+    ring->record_index++;
+    if (ring->record_index == ring->record_frames) {
+      stop_recording(G_OBJECT(gl_area));
+    }
+  }
+}
+
+// Turns the camera by a fixed step every frame, so a full turn always has
+// the same number of frames however fast they are rendered.
+static gboolean turntable_tick(GtkWidget *gl_area, GdkFrameClock *frame_clock,
+                               gpointer data) {
+  Camera *camera = g_object_get_data(G_OBJECT(gl_area), "camera");
+  CaptureRing *ring = g_object_get_data(G_OBJECT(gl_area), "capture");
+
+  if (ring->record_index > 0) {
+    orbit_camera(camera, TURNTABLE_DEGREES_PER_FRAME, 0);
+  }
+  gtk_gl_area_queue_render(GTK_GL_AREA(gl_area));
+  return G_SOURCE_CONTINUE;
+}
+
+static void start_recording(GObject *gl_area, const char *base) {
+  CaptureRing *ring = g_object_get_data(gl_area, "capture");
+
+  snprintf(ring->record_base, sizeof(ring->record_base), "%s", base);
+  ring->record_frames = (unsigned int)(360.0 / TURNTABLE_DEGREES_PER_FRAME);
+  ring->record_index = 0;
+  ring->record_start = g_get_monotonic_time();
+  if (ring->tick_id == 0) {
+    ring->tick_id =
+        gtk_widget_add_tick_callback(GTK_WIDGET(gl_area), turntable_tick,
+                                     NULL, NULL);
+  }
+}
+
+// Pending readbacks are mapped and queued, then the encoder writes whatever
+// is still in its queue before it stops.
+static void close_capture(GtkWidget *gl_area) {
+  CaptureRing *ring = g_object_get_data(G_OBJECT(gl_area), "capture");
+
+  stop_recording(G_OBJECT(gl_area));
+  if (ring->poll_id != 0) g_source_remove(ring->poll_id);
+  ring->poll_id = 0;
+  for (unsigned int i = 0; i < CAPTURE_PBO_COUNT; i++) {
+    unsigned int slot = (ring->next + i) % CAPTURE_PBO_COUNT;
+    if (ring->fence[slot] != NULL) finish_readback(ring, slot);
+    memory_track(MEMORY_GPU, -(long long)ring->capacity[slot]);
+    ring->capacity[slot] = 0;
+  }
+  glDeleteBuffers(CAPTURE_PBO_COUNT, ring->pbo);
+  capture_close(&ring->queue);
+}
+
 static gboolean render(GtkWidget *gl_area, GdkGLContext *context) {
+  gint64 frame_start = g_get_monotonic_time();
   Settings *settings = g_object_get_data(G_OBJECT(gl_area), "settings");
   ColorRGBA *color = &(settings->background_color);
   glClearColor(color->red, color->green, color->blue, color->alpha);
@@ -175,9 +738,18 @@ static gboolean render(GtkWidget *gl_area, GdkGLContext *context) {
         GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(gl_area), "vao"));
     glBindVertexArray(vao);
 
-    unsigned int size = model->vertex_count * 3 * sizeof(model->vertices[0]);
-    glBufferData(GL_ARRAY_BUFFER, size, model->vertices, GL_DYNAMIC_DRAW);
+    // Camera moves only touch the mvp uniform; vertices are re-uploaded only
+    // after Move/Rotate/Scale rewrote them.
+    if (g_object_get_data(G_OBJECT(gl_area), "geometry-dirty")) {
+      unsigned int vbo =
+          GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(gl_area), "vbo"));
+      glBindBuffer(GL_ARRAY_BUFFER, vbo);
+      upload_vertices(model);
+      if (model->triangle_count > 0) upload_normals(gl_area, model);
+      g_object_set_data(G_OBJECT(gl_area), "geometry-dirty", NULL);
+    }
 
+    update_section(gl_area, model);
     glLineWidth(settings->edge_thickness);
 
     if (settings->edge_type == DASHED_EDGE) {
@@ -186,23 +758,112 @@ static gboolean render(GtkWidget *gl_area, GdkGLContext *context) {
     } else
       glDisable(GL_LINE_STIPPLE);
 
-    if (settings->projection == PARALLEL_PROJECTION) {
-      glOrtho(0.1, 1., 0.1, 1., 0.1, 100.);
-    } else {
-      glMatrixMode(GL_PROJECTION);
-      glLoadIdentity();
-      glFrustum(-1., 1., -1., 1., 1., 100.);
-      glMatrixMode(GL_MODELVIEW);
-    }
-
     draw(gl_area, context, settings, model);
     glBindVertexArray(0);
   }
 
+  capture_rendered_frame(gl_area);
   glFlush();
+  update_frame_rate(G_OBJECT(gl_area), frame_start);
+  report_startup(G_OBJECT(gl_area));
   return TRUE;
 }
 
+static gboolean camera_tick(GtkWidget *gl_area, GdkFrameClock *frame_clock,
+                            gpointer data) {
+  InputState *input = g_object_get_data(G_OBJECT(gl_area), "input");
+  Camera *camera = g_object_get_data(G_OBJECT(gl_area), "camera");
+  gboolean result = G_SOURCE_CONTINUE;
+
+  if (input->orbit_x || input->orbit_y || input->pan_x || input->pan_y ||
+      input->zoom) {
+    int height = gtk_widget_get_height(gl_area);
+    double units_per_pixel =
+        height > 0 ? 2 * camera_half_height(camera) / height : 0;
+
+    orbit_camera(camera, input->orbit_x * ORBIT_DEGREES_PER_PIXEL,
+                 input->orbit_y * ORBIT_DEGREES_PER_PIXEL);
+    pan_camera(camera, input->pan_x * units_per_pixel,
+               -input->pan_y * units_per_pixel);
+    zoom_camera(camera, pow(ZOOM_STEP, input->zoom));
+
+    input->orbit_x = input->orbit_y = 0;
+    input->pan_x = input->pan_y = 0;
+    input->zoom = 0;
+    gtk_gl_area_queue_render(GTK_GL_AREA(gl_area));
+  } else {
+    // Nothing arrived since the last frame: stop ticking until new input.
+    input->tick_id = 0;
+    result = G_SOURCE_REMOVE;
+  }
+
+  return result;
+}
+
+static void request_camera_tick(GtkWidget *gl_area, InputState *input) {
+  if (input->tick_id == 0) {
+    input->tick_id =
+        gtk_widget_add_tick_callback(gl_area, camera_tick, NULL, NULL);
+  }
+}
+
+static void drag_begin(GtkGestureDrag *gesture, double x, double y,
+                       GtkWidget *gl_area) {
+  InputState *input = g_object_get_data(G_OBJECT(gl_area), "input");
+  input->last_x = 0;
+  input->last_y = 0;
+}
+
+static void drag_update(GtkGestureDrag *gesture, double offset_x,
+                        double offset_y, GtkWidget *gl_area) {
+  InputState *input = g_object_get_data(G_OBJECT(gl_area), "input");
+  double dx = offset_x - input->last_x;
+  double dy = offset_y - input->last_y;
+  input->last_x = offset_x;
+  input->last_y = offset_y;
+
+  guint button =
+      gtk_gesture_single_get_current_button(GTK_GESTURE_SINGLE(gesture));
+  if (button == GDK_BUTTON_PRIMARY) {
+    input->orbit_x += dx;
+    input->orbit_y += dy;
+  } else {
+    input->pan_x += dx;
+    input->pan_y += dy;
+  }
+
+  request_camera_tick(gl_area, input);
+}
+
+static gboolean scroll(GtkEventControllerScroll *controller, double dx,
+                       double dy, GtkWidget *gl_area) {
+  InputState *input = g_object_get_data(G_OBJECT(gl_area), "input");
+  input->zoom += dy;
+  request_camera_tick(gl_area, input);
+  return TRUE;
+}
+
+static void set_camera_controls(GtkWidget *gl_area) {
+  GtkGesture *drag = gtk_gesture_drag_new();
+  gtk_gesture_single_set_button(GTK_GESTURE_SINGLE(drag), 0);
+  g_signal_connect(drag, "drag-begin", G_CALLBACK(drag_begin), gl_area);
+  g_signal_connect(drag, "drag-update", G_CALLBACK(drag_update), gl_area);
+  gtk_widget_add_controller(gl_area, GTK_EVENT_CONTROLLER(drag));
+
+  GtkEventController *zoom =
+      gtk_event_controller_scroll_new(GTK_EVENT_CONTROLLER_SCROLL_VERTICAL);
+  g_signal_connect(zoom, "scroll", G_CALLBACK(scroll), gl_area);
+  gtk_widget_add_controller(gl_area, zoom);
+}
+
+static void update_memory_status(GObject *gl_area) {
+  GtkLabel *label = g_object_get_data(gl_area, "memory");
+  char str_memory[128];
+  snprintf(str_memory, sizeof(str_memory), "Memory: %.1f MB (peak %.1f MB)",
+           memory_current() / MEGABYTE, memory_peak() / MEGABYTE);
+  gtk_label_set_label(label, str_memory);
+}
+
 void load_buffer(GtkWidget *gl_area) {
   gtk_gl_area_make_current(GTK_GL_AREA(gl_area));
   if (gtk_gl_area_get_error(GTK_GL_AREA(gl_area)) != NULL) return;
@@ -212,50 +873,455 @@ void load_buffer(GtkWidget *gl_area) {
   glBindVertexArray(vao);
 
   Model1 *model = g_object_get_data(G_OBJECT(gl_area), "model");
+  size_t *gpu_bytes = g_object_get_data(G_OBJECT(gl_area), "gpu-bytes");
+  size_t vertex_size = model->float_vertices ? sizeof(float) : sizeof(double);
 
   unsigned int vbo =
       GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(gl_area), "vbo"));
   glBindBuffer(GL_ARRAY_BUFFER, vbo);
-  unsigned int size = model->vertex_count * 3 * sizeof(model->vertices[0]);
-  glBufferData(GL_ARRAY_BUFFER, size, model->vertices, GL_STATIC_DRAW);
+  unsigned int size = model->vertex_count * 3 * vertex_size;
+  glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+  upload_vertices(model);
 
+  // A point cloud has no faces; its element buffer holds the point order.
+  PointCloud *points = g_object_get_data(G_OBJECT(gl_area), "points");
   unsigned int ebo =
       GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(gl_area), "ebo"));
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-  size = model->face_count * sizeof(model->faces[0]);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, model->faces, GL_STATIC_DRAW);
+  if (points->order != NULL) {
+    size = points->point_count * sizeof(points->order[0]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, points->order, GL_STATIC_DRAW);
+  } else {
+    upload_line_loops(model);
+  }
+
+  if (model->float_vertices)
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float),
+                          (void *)0);
+  else
+    glVertexAttribPointer(0, 3, GL_DOUBLE, GL_TRUE, 3 * sizeof(double),
+                          (void *)0);
+
+  unsigned int shaded_vao =
+      GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(gl_area), "shaded-vao"));
+  glBindVertexArray(shaded_vao);
+  if (model->float_vertices)
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float),
+                          (void *)0);
+  else
+    glVertexAttribPointer(0, 3, GL_DOUBLE, GL_TRUE, 3 * sizeof(double),
+                          (void *)0);
+  glEnableVertexAttribArray(0);
 
-  glVertexAttribPointer(0, 3, GL_DOUBLE, GL_TRUE, 3 * sizeof(double),
+  unsigned int nbo =
+      GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(gl_area), "nbo"));
+  glBindBuffer(GL_ARRAY_BUFFER, nbo);
+  size = model->triangle_count > 0
+             ? model->normal_count * 3 * sizeof(model->normals[0])
+             : 0;
+  glBufferData(GL_ARRAY_BUFFER, size, model->normals, GL_DYNAMIC_DRAW);
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float),
                         (void *)0);
+  glEnableVertexAttribArray(1);
+
+  unsigned int tbo =
+      GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(gl_area), "tbo"));
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, tbo);
+  unsigned int triangle_size =
+      model->triangle_count * 3 * sizeof(model->triangles[0]);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, triangle_size, model->triangles,
+               GL_STATIC_DRAW);
+  glBindVertexArray(vao);
+
+  size_t new_gpu_bytes =
+      estimate_gpu_bytes(model->vertex_count,
+                         line_loop_count(model) + points->point_count,
+                         model->float_vertices) +
+      size + triangle_size;
+  memory_track(MEMORY_GPU, (long long)new_gpu_bytes - (long long)*gpu_bytes);
+  *gpu_bytes = new_gpu_bytes;
+  update_memory_status(G_OBJECT(gl_area));
+  mark_section_dirty(G_OBJECT(gl_area));
 
   gtk_widget_queue_draw(gl_area);
 }
 
-static void open_dialog_response(GtkNativeDialog *dialog, int response,
-                                 GObject *gl_area) {
-  gtk_native_dialog_hide(dialog);
+static void update_model_status(GObject *gl_area, const char *prefix,
+                                const char *filename) {
+  Model1 *model = g_object_get_data(gl_area, "model");
+  Topology *topology = g_object_get_data(gl_area, "topology");
+  PointCloud *points = g_object_get_data(gl_area, "points");
+  GtkLabel *status = g_object_get_data(gl_area, "status");
+  char str_status[512];
+
+  if (points->order != NULL) {
+    snprintf(str_status, sizeof(str_status),
+             "%s: %s (point cloud, %u points)", prefix, filename,
+             points->point_count);
+  } else if (topology->polygon_start != NULL) {
+    snprintf(str_status, sizeof(str_status),
+             "%s: %s (%u vertices, %u edges, %u boundary, "
+             "%u non-manifold, %u components)",
+             prefix, filename, model->vertex_count, topology->edge_count,
+             topology->boundary_edge_count, topology->non_manifold_edge_count,
+             topology->component_count);
+  } else {
+    snprintf(str_status, sizeof(str_status), "%s: %s (%d vertices, %d edges)",
+             prefix, filename, model->vertex_count, model->polygon_count);
+  }
+  gtk_label_set_label(status, str_status);
+}
 
-  if (response == GTK_RESPONSE_ACCEPT) {
-    GFile *file = gtk_file_chooser_get_file(GTK_FILE_CHOOSER(dialog));
-    const char *filename = g_file_peek_path(file);
+// The library only returns its errors; steps that leave the model usable
+// are reported here and the viewer goes on without them.
+static void print_model_error(const char *filename, const ModelError *error) {
+  char str_error[MODEL_ERROR_LENGTH + 32];
+
+  format_model_error(error, str_error, sizeof(str_error));
+  fprintf(stderr, "%s: %s\n", filename, str_error);
+}
+
+static void update_error_status(GObject *gl_area, const char *prefix,
+                                const char *filename, const ModelError *error) {
+  char str_error[MODEL_ERROR_LENGTH + 32];
+  char str_status[MODEL_ERROR_LENGTH + 512];
+
+  format_model_error(error, str_error, sizeof(str_error));
+  snprintf(str_status, sizeof(str_status), "%s %s: %s", prefix, filename,
+           str_error);
+  gtk_label_set_label(g_object_get_data(gl_area, "status"), str_status);
+}
+
+static void file_changed(GFileMonitor *monitor, GFile *file, GFile *other,
+                         GFileMonitorEvent event, GObject *gl_area);
+
+// The file is watched only while auto reload is on; the untransformed copy
+// in "source" is what the next reload is diffed against.
+static void watch_model_file(GObject *gl_area) {
+  Settings *settings = g_object_get_data(gl_area, "settings");
+  Model1 *model = g_object_get_data(gl_area, "model");
+  Model1 *source = g_object_get_data(gl_area, "source");
+  const char *filename = g_object_get_data(gl_area, "filename");
+  GFileMonitor *monitor = NULL;
+
+  if (settings->auto_reload && filename != NULL) {
+    GFile *file = g_file_new_for_path(filename);
+    monitor = g_file_monitor_file(file, G_FILE_MONITOR_NONE, NULL, NULL);
     g_object_unref(file);
+    if (monitor) {
+      g_signal_connect(monitor, "changed", G_CALLBACK(file_changed), gl_area);
+    }
+  }
+  g_object_set_data_full(gl_area, "monitor", monitor,
+                         monitor ? g_object_unref : NULL);
 
-    Model1 *model = g_object_get_data(gl_area, "model");
+  // Without a source copy the first reload simply uploads everything.
+  if (!settings->auto_reload || model->vertex_count == 0) {
+    free_model(source);
+  }
+}
+
+// The buffers of a dropped model are emptied before the next load, so its
+// budget check does not count the old model's GPU memory as well.
+static void release_gpu_buffers(GObject *gl_area) {
+  size_t *gpu_bytes = g_object_get_data(gl_area, "gpu-bytes");
+  const char *buffers[] = {"vbo", "ebo", "nbo", "tbo"};
+
+  if (gtk_widget_get_realized(GTK_WIDGET(gl_area))) {
+    gtk_gl_area_make_current(GTK_GL_AREA(gl_area));
+    if (gtk_gl_area_get_error(GTK_GL_AREA(gl_area)) == NULL) {
+      for (int i = 0; i < 4; i++) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER,
+                     GPOINTER_TO_UINT(g_object_get_data(gl_area, buffers[i])));
+        glBufferData(GL_COPY_WRITE_BUFFER, 0, NULL, GL_STATIC_DRAW);
+      }
+      glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+  }
+  memory_track(MEMORY_GPU, -(long long)*gpu_bytes);
+  *gpu_bytes = 0;
+}
+
+static void open_model(GObject *gl_area, const char *filename) {
+  Model1 *model = g_object_get_data(gl_area, "model");
+  Model1 *source = g_object_get_data(gl_area, "source");
+  Topology *topology = g_object_get_data(gl_area, "topology");
+  PointCloud *points = g_object_get_data(gl_area, "points");
+  Settings *settings = g_object_get_data(gl_area, "settings");
+  Matrix *transform = g_object_get_data(gl_area, "transform");
+  BoundingSphere *sphere = g_object_get_data(gl_area, "sphere");
+  Camera *camera = g_object_get_data(gl_area, "camera");
+  unsigned int *model_generation =
+      g_object_get_data(gl_area, "model-generation");
+  free_topology(topology);
+  free_point_cloud(points);
+  free_model(source);
+  free_model(model);
+  release_gpu_buffers(gl_area);
+  (*model_generation)++;
+  g_object_set_data_full(gl_area, "filename", g_strdup(filename), g_free);
+  ModelError error;
+
+  if (load_model_with_error(filename, model, &error) == OK) {
+    if (model->polygon_count == 0 && model->vertex_count > 0) {
+      if (build_point_cloud(model, points, &error) != OK)
+        print_model_error(filename, &error);
+    } else if (build_topology(model, topology, &error) != OK) {
+      print_model_error(filename, &error);
+    }
+    update_model_status(gl_area, "File", filename);
+
+    if (settings->auto_reload && copy_model(model, source, &error) != OK)
+      print_model_error(filename, &error);
+    // Shading needs faces; a point cloud would only pay for its normals.
+    if (points->order == NULL && prepare_shading(model, &error) != OK)
+      print_model_error(filename, &error);
+    *transform = translate_to_origin(model);
+    *transform = mult_matrices(scale1(model), *transform);
+    bounding_sphere(model, sphere);
+    reset_camera(camera);
+    fit_camera(camera, sphere, view_aspect(GTK_WIDGET(gl_area)));
+
+    load_buffer(GTK_WIDGET(gl_area));
+  } else {
     free_model(model);
+    update_memory_status(gl_area);
+    update_error_status(gl_area, "Could not load", filename, &error);
+  }
+  watch_model_file(gl_area);
+}
 
-    if (load_model(filename, model) == OK) {
-      GtkLabel *status = g_object_get_data(gl_area, "status");
-      char str_status[256];
-      sprintf(str_status, "File: %s (%d vertices, %d edges)", filename,
-              model->vertex_count, model->polygon_count);
-      gtk_label_set_label(status, str_status);
+static void free_reload_job(gpointer data) {
+  ReloadJob *job = data;
+  g_free(job->filename);
+  free_model(&job->source_old);
+  free_model(&job->source);
+  free_model(&job->display);
+  free_topology(&job->topology);
+  free_point_cloud(&job->points);
+  g_free(job);
+}
 
-      translate_to_origin(model);
-      scale1(model);
+// Runs on a GTask worker: parse, diff against the previous source, then
+// rebuild the displayed model the same way open_model does.
+static void reload_thread(GTask *task, gpointer gl_area, gpointer data,
+                          GCancellable *cancellable) {
+  ReloadJob *job = data;
+
+  job->error_code =
+      load_model_with_error(job->filename, &job->source, &job->error);
+  if (job->error_code == OK && job->source.polygon_count == 0 &&
+      job->source.vertex_count > 0) {
+    job->error_code =
+        build_point_cloud(&job->source, &job->points, &job->error);
+  }
+  if (job->error_code == OK) {
+    diff_models(&job->source_old, &job->source, &job->diff);
+    job->error_code = copy_model(&job->source, &job->display, &job->error);
+  }
+  if (job->error_code == OK && job->points.order == NULL) {
+    ModelError error;
+    if (prepare_shading(&job->display, &error) != OK)
+      print_model_error(job->filename, &error);
+    if ((job->diff.layout_changed || job->diff.faces.count > 0) &&
+        build_topology(&job->display, &job->topology, &error) != OK) {
+      print_model_error(job->filename, &error);
+    }
+  }
+  if (job->error_code == OK) {
+    modify_model(&job->display, job->transform);
+    job->error_code = bounding_sphere(&job->display, &job->sphere);
+  }
+  if (job->error_code != OK) {
+    // The bounding sphere fails on memory alone and leaves no message.
+    set_model_error(&job->error, MODEL_ERROR_MEMORY, 0,
+                    "Not enough memory to rebuild the model");
+  }
 
+  g_task_return_boolean(task, job->error_code == OK);
+}
+
+static void upload_ranges(GLenum target, const void *data,
+                          size_t element_size, const RangeList *ranges) {
+  for (unsigned int i = 0; i < ranges->count; i++) {
+    glBufferSubData(target, ranges->first[i] * element_size,
+                    ranges->length[i] * element_size,
+                    (const char *)data + ranges->first[i] * element_size);
+  }
+}
+
+// Same layout as the buffers on the GPU: only the changed ranges of the
+// vertex, normal and triangle buffers are rewritten.
+static void upload_changes(GtkWidget *gl_area, Model1 *model,
+                           const ModelDiff *diff, const RangeList *normals,
+                           const RangeList *triangles) {
+  gtk_gl_area_make_current(GTK_GL_AREA(gl_area));
+  if (gtk_gl_area_get_error(GTK_GL_AREA(gl_area)) != NULL) return;
+
+  glBindVertexArray(
+      GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(gl_area), "vao")));
+  glBindBuffer(GL_ARRAY_BUFFER,
+               GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(gl_area), "vbo")));
+  for (unsigned int i = 0; i < diff->vertices.count; i++) {
+    upload_vertex_range(model, diff->vertices.first[i],
+                        diff->vertices.length[i]);
+  }
+  // The polygon layout is unchanged here, so every restart marker stays in
+  // place and only the line loop spans of the changed corners are rewritten.
+  for (unsigned int i = 0; i < diff->faces.count; i++) {
+    upload_line_loop_span(model, diff->faces.first[i],
+                          diff->faces.first[i] + diff->faces.length[i]);
+  }
+
+  glBindVertexArray(
+      GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(gl_area), "shaded-vao")));
+  glBindBuffer(GL_ARRAY_BUFFER,
+               GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(gl_area), "nbo")));
+  upload_ranges(GL_ARRAY_BUFFER, model->normals, sizeof(float) * 3, normals);
+  upload_ranges(GL_ELEMENT_ARRAY_BUFFER, model->triangles,
+                sizeof(unsigned int) * 3, triangles);
+  glBindVertexArray(0);
+  mark_section_dirty(G_OBJECT(gl_area));
+
+  gtk_widget_queue_draw(gl_area);
+}
+
+static void start_reload(GObject *gl_area);
+
+static void reload_done(GObject *gl_area, GAsyncResult *result,
+                        gpointer data) {
+  ReloadJob *job = g_task_get_task_data(G_TASK(result));
+  Model1 *model = g_object_get_data(gl_area, "model");
+  Model1 *source = g_object_get_data(gl_area, "source");
+  Topology *topology = g_object_get_data(gl_area, "topology");
+  PointCloud *points = g_object_get_data(gl_area, "points");
+  Settings *settings = g_object_get_data(gl_area, "settings");
+  unsigned int *model_generation =
+      g_object_get_data(gl_area, "model-generation");
+  unsigned int *transform_generation =
+      g_object_get_data(gl_area, "transform-generation");
+  gboolean same_model = job->model_generation == *model_generation;
+  g_object_set_data(gl_area, "reload-running", NULL);
+
+  if (!same_model || !settings->auto_reload ||
+      !gtk_widget_get_realized(GTK_WIDGET(gl_area))) {
+    // Another file was opened or watching stopped: the result is stale.
+  } else if (job->error_code != OK) {
+    // A half-written file is retried on its next change event.
+    *source = job->source_old;
+    memset(&job->source_old, 0, sizeof(Model1));
+    update_error_status(gl_area, "Reload failed, keeping the previous model:",
+                        job->filename, &job->error);
+  } else if (job->transform_generation != *transform_generation) {
+    // The model was moved while the file was parsed: redo with the new
+    // transform rather than show the file at the old place.
+    *source = job->source_old;
+    memset(&job->source_old, 0, sizeof(Model1));
+    g_object_set_data(gl_area, "reload-pending", GINT_TO_POINTER(1));
+  } else {
+    // A moved point changes the point order, so point clouds always
+    // re-upload their whole element buffer.
+    gboolean full = job->diff.layout_changed || job->points.order != NULL ||
+                    points->order != NULL ||
+                    model->normal_count != job->display.normal_count ||
+                    model->triangle_count != job->display.triangle_count ||
+                    model->float_vertices != job->display.float_vertices;
+    RangeList normals = {0};
+    RangeList triangles = {0};
+    if (!full) {
+      diff_ranges(model->normals, job->display.normals, model->normal_count,
+                  sizeof(float) * 3, &normals);
+      diff_ranges(model->triangles, job->display.triangles,
+                  model->triangle_count, sizeof(unsigned int) * 3,
+                  &triangles);
+    }
+
+    free_model(model);
+    *model = job->display;
+    memset(&job->display, 0, sizeof(Model1));
+    *source = job->source;
+    memset(&job->source, 0, sizeof(Model1));
+    if (job->diff.layout_changed || job->diff.faces.count > 0) {
+      free_topology(topology);
+      *topology = job->topology;
+      memset(&job->topology, 0, sizeof(Topology));
+    }
+    free_point_cloud(points);
+    *points = job->points;
+    memset(&job->points, 0, sizeof(PointCloud));
+    *(BoundingSphere *)g_object_get_data(gl_area, "sphere") = job->sphere;
+
+    if (full) {
       load_buffer(GTK_WIDGET(gl_area));
-    } else
-      free_model(model);
+    } else {
+      upload_changes(GTK_WIDGET(gl_area), model, &job->diff, &normals,
+                     &triangles);
+      update_memory_status(gl_area);
+    }
+    update_model_status(gl_area, "Reloaded", job->filename);
+  }
+
+  if (g_object_get_data(gl_area, "reload-pending")) {
+    g_object_set_data(gl_area, "reload-pending", NULL);
+    start_reload(gl_area);
+  }
+}
+
+// At most one reload runs at a time; changes that arrive meanwhile are
+// collapsed into a single follow-up reload.
+static void start_reload(GObject *gl_area) {
+  const char *filename = g_object_get_data(gl_area, "filename");
+
+  if (g_object_get_data(gl_area, "reload-running")) {
+    g_object_set_data(gl_area, "reload-pending", GINT_TO_POINTER(1));
+  } else if (filename != NULL) {
+    Model1 *source = g_object_get_data(gl_area, "source");
+    ReloadJob *job = g_new0(ReloadJob, 1);
+    job->filename = g_strdup(filename);
+    job->model_generation =
+        *(unsigned int *)g_object_get_data(gl_area, "model-generation");
+    job->transform_generation =
+        *(unsigned int *)g_object_get_data(gl_area, "transform-generation");
+    job->transform = *(Matrix *)g_object_get_data(gl_area, "transform");
+    job->source_old = *source;
+    memset(source, 0, sizeof(Model1));
+
+    GTask *task = g_task_new(gl_area, NULL, reload_done, NULL);
+    g_task_set_task_data(task, job, free_reload_job);
+    g_task_run_in_thread(task, reload_thread);
+    g_object_unref(task);
+    g_object_set_data(gl_area, "reload-running", GINT_TO_POINTER(1));
+  }
+}
+
+static gboolean reload_timeout(gpointer gl_area) {
+  g_object_set_data(G_OBJECT(gl_area), "reload-timeout", NULL);
+  start_reload(G_OBJECT(gl_area));
+  return G_SOURCE_REMOVE;
+}
+
+// Editors write in several steps, so a reload starts only after the file
+// has been quiet for RELOAD_DELAY_MS.
+static void file_changed(GFileMonitor *monitor, GFile *file, GFile *other,
+                         GFileMonitorEvent event, GObject *gl_area) {
+  if (event == G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT ||
+      event == G_FILE_MONITOR_EVENT_CREATED) {
+    guint timeout =
+        GPOINTER_TO_UINT(g_object_get_data(gl_area, "reload-timeout"));
+    if (timeout) g_source_remove(timeout);
+    timeout = g_timeout_add(RELOAD_DELAY_MS, reload_timeout, gl_area);
+    g_object_set_data(gl_area, "reload-timeout", GUINT_TO_POINTER(timeout));
+  }
+}
+
+static void open_dialog_response(GtkNativeDialog *dialog, int response,
+                                 GObject *gl_area) {
+  gtk_native_dialog_hide(dialog);
+
+  if (response == GTK_RESPONSE_ACCEPT) {
+    GFile *file = gtk_file_chooser_get_file(GTK_FILE_CHOOSER(dialog));
+    open_model(gl_area, g_file_peek_path(file));
+    g_object_unref(file);
   }
 
   gtk_native_dialog_destroy(dialog);
@@ -278,6 +1344,11 @@ static void clicked_open(GtkWidget *button, GObject *gl_area) {
 
   filter = gtk_file_filter_new();
   gtk_file_filter_add_suffix(filter, "obj");
+  gtk_file_filter_add_pattern(filter, "*.obj.gz");
+  gtk_file_filter_add_pattern(filter, "*.obj.zst");
+  gtk_file_filter_add_pattern(filter, "*" BINARY_EXTENSION);
+  gtk_file_filter_add_suffix(filter, "ply");
+  gtk_file_filter_add_suffix(filter, "stl");
   gtk_file_filter_set_name(filter, "Objects");
   gtk_file_chooser_add_filter(GTK_FILE_CHOOSER(dialog), filter);
   g_object_unref(filter);
@@ -291,6 +1362,167 @@ static void clicked_open(GtkWidget *button, GObject *gl_area) {
   gtk_native_dialog_show(GTK_NATIVE_DIALOG(dialog));
 }
 
+static void export_dialog_response(GtkNativeDialog *dialog, int response,
+                                   GObject *gl_area) {
+  gtk_native_dialog_hide(dialog);
+
+  if (response == GTK_RESPONSE_ACCEPT) {
+    GFile *file = gtk_file_chooser_get_file(GTK_FILE_CHOOSER(dialog));
+    const char *filename = g_file_peek_path(file);
+    Model1 *model = g_object_get_data(gl_area, "model");
+    gint64 start = g_get_monotonic_time();
+
+    ModelError error;
+    int error_code = g_str_has_suffix(filename, BINARY_EXTENSION)
+                         ? export_model_binary(filename, model, &error)
+                         : export_model_obj(filename, model, &error);
+
+    if (error_code == OK) {
+      char str_status[256];
+      snprintf(str_status, sizeof(str_status), "Exported: %s (%.0f ms)",
+               filename, (g_get_monotonic_time() - start) / 1000.0);
+      gtk_label_set_label(g_object_get_data(gl_area, "status"), str_status);
+    } else {
+      print_model_error(filename, &error);
+      update_error_status(gl_area, "Export failed:", filename, &error);
+    }
+    g_object_unref(file);
+  }
+
+  gtk_native_dialog_destroy(dialog);
+}
+
+static void clicked_export(GtkWidget *button, GObject *gl_area) {
+  GtkFileChooserNative *dialog;
+  GtkFileFilter *filter;
+
+  dialog = gtk_file_chooser_native_new(
+      "Export the object",
+      GTK_WINDOW(gtk_widget_get_ancestor(button, GTK_TYPE_WINDOW)),
+      GTK_FILE_CHOOSER_ACTION_SAVE, "_Save", "_Cancel");
+  gtk_file_chooser_set_current_name(GTK_FILE_CHOOSER(dialog), "model.obj");
+
+  filter = gtk_file_filter_new();
+  gtk_file_filter_add_suffix(filter, "obj");
+  gtk_file_filter_set_name(filter, "Wavefront OBJ");
+  gtk_file_chooser_add_filter(GTK_FILE_CHOOSER(dialog), filter);
+  g_object_unref(filter);
+
+  filter = gtk_file_filter_new();
+  gtk_file_filter_add_pattern(filter, "*" BINARY_EXTENSION);
+  gtk_file_filter_set_name(filter, "Binary model");
+  gtk_file_chooser_add_filter(GTK_FILE_CHOOSER(dialog), filter);
+  g_object_unref(filter);
+
+  gtk_native_dialog_set_modal(GTK_NATIVE_DIALOG(dialog), TRUE);
+  g_signal_connect(dialog, "response", G_CALLBACK(export_dialog_response),
+                   gl_area);
+  gtk_native_dialog_show(GTK_NATIVE_DIALOG(dialog));
+}
+
+static void add_image_filters(GtkFileChooser *chooser) {
+  GtkFileFilter *filter = gtk_file_filter_new();
+  gtk_file_filter_add_suffix(filter, "png");
+  gtk_file_filter_set_name(filter, "PNG image");
+  gtk_file_chooser_add_filter(chooser, filter);
+  g_object_unref(filter);
+
+  filter = gtk_file_filter_new();
+  gtk_file_filter_add_suffix(filter, "bmp");
+  gtk_file_filter_set_name(filter, "BMP image");
+  gtk_file_chooser_add_filter(chooser, filter);
+  g_object_unref(filter);
+}
+
+static void screenshot_dialog_response(GtkNativeDialog *dialog, int response,
+                                       GObject *gl_area) {
+  gtk_native_dialog_hide(dialog);
+
+  if (response == GTK_RESPONSE_ACCEPT) {
+    GFile *file = gtk_file_chooser_get_file(GTK_FILE_CHOOSER(dialog));
+    CaptureRing *ring = g_object_get_data(gl_area, "capture");
+    snprintf(ring->screenshot, sizeof(ring->screenshot), "%s",
+             g_file_peek_path(file));
+    gtk_gl_area_queue_render(GTK_GL_AREA(gl_area));
+    g_object_unref(file);
+  }
+
+  gtk_native_dialog_destroy(dialog);
+}
+
+// The next rendered frame is read back and written by the encoder thread.
+static void clicked_screenshot(GtkWidget *button, GObject *gl_area) {
+  GtkFileChooserNative *dialog = gtk_file_chooser_native_new(
+      "Save a screenshot",
+      GTK_WINDOW(gtk_widget_get_ancestor(button, GTK_TYPE_WINDOW)),
+      GTK_FILE_CHOOSER_ACTION_SAVE, "_Save", "_Cancel");
+  gtk_file_chooser_set_current_name(GTK_FILE_CHOOSER(dialog),
+                                    "screenshot.png");
+  add_image_filters(GTK_FILE_CHOOSER(dialog));
+
+  gtk_native_dialog_set_modal(GTK_NATIVE_DIALOG(dialog), TRUE);
+  g_signal_connect(dialog, "response", G_CALLBACK(screenshot_dialog_response),
+                   gl_area);
+  gtk_native_dialog_show(GTK_NATIVE_DIALOG(dialog));
+}
+
+static void record_dialog_response(GtkNativeDialog *dialog, int response,
+                                   GObject *gl_area) {
+  gtk_native_dialog_hide(dialog);
+
+  if (response == GTK_RESPONSE_ACCEPT) {
+    GFile *file = gtk_file_chooser_get_file(GTK_FILE_CHOOSER(dialog));
+    start_recording(gl_area, g_file_peek_path(file));
+    g_object_unref(file);
+  } else {
+    stop_recording(gl_area);
+  }
+
+  gtk_native_dialog_destroy(dialog);
+}
+
+// A turntable is one full turn of the camera, saved as numbered images
+// next to the chosen name; releasing the button stops it early.
+static void record_toggled(GtkToggleButton *button, GObject *gl_area) {
+  if (!gtk_toggle_button_get_active(button)) {
+    stop_recording(gl_area);
+  } else {
+    GtkFileChooserNative *dialog = gtk_file_chooser_native_new(
+        "Record a turntable",
+        GTK_WINDOW(gtk_widget_get_ancestor(GTK_WIDGET(button),
+                                           GTK_TYPE_WINDOW)),
+        GTK_FILE_CHOOSER_ACTION_SAVE, "_Record", "_Cancel");
+    gtk_file_chooser_set_current_name(GTK_FILE_CHOOSER(dialog),
+                                      "turntable.png");
+    add_image_filters(GTK_FILE_CHOOSER(dialog));
+
+    gtk_native_dialog_set_modal(GTK_NATIVE_DIALOG(dialog), TRUE);
+    g_signal_connect(dialog, "response", G_CALLBACK(record_dialog_response),
+                     gl_area);
+    gtk_native_dialog_show(GTK_NATIVE_DIALOG(dialog));
+  }
+}
+
+static void section_toggled(GtkCheckButton *check_btn, GObject *gl_area) {
+  Section *section = g_object_get_data(gl_area, "section");
+  const char *label = gtk_check_button_get_label(check_btn);
+
+  if (strstr(label, "Section"))
+    section->enabled = gtk_check_button_get_active(check_btn);
+  else if (gtk_check_button_get_active(check_btn))
+    section->axis = label[0] - 'X';
+
+  section->lines_dirty = 1;
+  gtk_widget_queue_draw(GTK_WIDGET(gl_area));
+}
+
+static void section_moved(GtkRange *range, GObject *gl_area) {
+  Section *section = g_object_get_data(gl_area, "section");
+  section->position = gtk_range_get_value(range);
+  section->lines_dirty = 1;
+  gtk_widget_queue_draw(GTK_WIDGET(gl_area));
+}
+
 static void color_set(GtkColorButton *button, GObject *gl_area) {
   Settings *settings = g_object_get_data(G_OBJECT(gl_area), "settings");
   const char *name = gtk_widget_get_name(GTK_WIDGET(button));
@@ -313,10 +1545,29 @@ static void check_toggled(GtkCheckButton *check_btn, GObject *gl_area) {
   if (strstr(label, "Dashed"))
     settings->edge_type = gtk_check_button_get_active(check_btn);
 
+  if (strstr(label, "Auto reload")) {
+    settings->auto_reload = gtk_check_button_get_active(check_btn);
+    watch_model_file(gl_area);
+  }
+
+  if (strstr(label, "Float")) {
+    settings->memory_policy = gtk_check_button_get_active(check_btn)
+                                  ? MEMORY_FLOAT_FALLBACK
+                                  : MEMORY_REFUSE;
+    set_memory_budget(settings->memory_budget * MEGABYTE,
+                      settings->memory_policy);
+  }
+
   if (gtk_check_button_get_active(check_btn)) {
     if (strstr(label, "None")) settings->edge_display_method = NONE_EDGE;
     if (strstr(label, "Circle")) settings->edge_display_method = CIRCLE_EDGE;
     if (strstr(label, "Square")) settings->edge_display_method = SQUARE_EDGE;
+    if (strstr(label, "Wireframe"))
+      settings->display_mode = DISPLAY_WIREFRAME;
+    else if (strstr(label, "edges"))
+      settings->display_mode = DISPLAY_SHADED_WIREFRAME;
+    else if (strstr(label, "Shaded"))
+      settings->display_mode = DISPLAY_SHADED;
   }
 
   gtk_widget_queue_draw(GTK_WIDGET(gl_area));
@@ -329,7 +1580,11 @@ static void changed(GtkSpinButton *spin, GObject *gl_area) {
 
   if (strstr(name, "point"))
     settings->vertex_size = size;
-  else
+  else if (strstr(name, "budget")) {
+    settings->memory_budget = gtk_spin_button_get_value(spin);
+    set_memory_budget(settings->memory_budget * MEGABYTE,
+                      settings->memory_policy);
+  } else
     settings->edge_thickness = size;
 
   gtk_widget_queue_draw(GTK_WIDGET(gl_area));
@@ -364,6 +1619,34 @@ void set_settings(GtkBuilder *builder, Settings *settings, GObject *gl_area) {
   if (settings->edge_display_method == SQUARE_EDGE)
     gtk_check_button_set_active(GTK_CHECK_BUTTON(check_square), 1);
 
+  GObject *check_wireframe = gtk_builder_get_object(builder, "check-wireframe");
+  GObject *check_shaded = gtk_builder_get_object(builder, "check-shaded");
+  GObject *check_shaded_edges =
+      gtk_builder_get_object(builder, "check-shaded-edges");
+  g_signal_connect(check_wireframe, "toggled", G_CALLBACK(check_toggled),
+                   gl_area);
+  g_signal_connect(check_shaded, "toggled", G_CALLBACK(check_toggled), gl_area);
+  g_signal_connect(check_shaded_edges, "toggled", G_CALLBACK(check_toggled),
+                   gl_area);
+  if (settings->display_mode == DISPLAY_WIREFRAME)
+    gtk_check_button_set_active(GTK_CHECK_BUTTON(check_wireframe), 1);
+  if (settings->display_mode == DISPLAY_SHADED)
+    gtk_check_button_set_active(GTK_CHECK_BUTTON(check_shaded), 1);
+  if (settings->display_mode == DISPLAY_SHADED_WIREFRAME)
+    gtk_check_button_set_active(GTK_CHECK_BUTTON(check_shaded_edges), 1);
+
+  Section *section = g_object_get_data(gl_area, "section");
+  const char *section_checks[] = {"check-section", "check-section-x",
+                                  "check-section-y", "check-section-z"};
+  for (int i = 0; i < 4; i++) {
+    GObject *check = gtk_builder_get_object(builder, section_checks[i]);
+    g_signal_connect(check, "toggled", G_CALLBACK(section_toggled), gl_area);
+  }
+  GObject *scale_section = gtk_builder_get_object(builder, "scale-section");
+  section->position = gtk_range_get_value(GTK_RANGE(scale_section));
+  g_signal_connect(scale_section, "value-changed", G_CALLBACK(section_moved),
+                   gl_area);
+
   GObject *button_color = gtk_builder_get_object(builder, "button-color-bg");
   g_signal_connect(button_color, "color-set", G_CALLBACK(color_set), gl_area);
   const GdkRGBA *color = (const GdkRGBA *)&(settings->background_color);
@@ -384,18 +1667,44 @@ void set_settings(GtkBuilder *builder, Settings *settings, GObject *gl_area) {
   gtk_spin_button_set_value(GTK_SPIN_BUTTON(spin_edge),
                             settings->edge_thickness);
   g_signal_connect(spin_edge, "value-changed", G_CALLBACK(changed), gl_area);
+
+  set_memory_budget(settings->memory_budget * MEGABYTE,
+                    settings->memory_policy);
+  GObject *spin_budget = gtk_builder_get_object(builder, "spin-budget");
+  gtk_spin_button_set_value(GTK_SPIN_BUTTON(spin_budget),
+                            settings->memory_budget);
+  g_signal_connect(spin_budget, "value-changed", G_CALLBACK(changed), gl_area);
+  GObject *check_float = gtk_builder_get_object(builder, "check-float");
+  gtk_check_button_set_active(GTK_CHECK_BUTTON(check_float),
+                              settings->memory_policy == MEMORY_FLOAT_FALLBACK);
+  g_signal_connect(check_float, "toggled", G_CALLBACK(check_toggled), gl_area);
+
+  GObject *check_reload = gtk_builder_get_object(builder, "check-auto-reload");
+  gtk_check_button_set_active(GTK_CHECK_BUTTON(check_reload),
+                              settings->auto_reload);
+  g_signal_connect(check_reload, "toggled", G_CALLBACK(check_toggled),
+                   gl_area);
 }
 
-static void activate(GtkApplication *app) {
-  GtkBuilder *builder = gtk_builder_new_from_file("3dviewer_view.ui");
-  GtkWidget *window = GTK_WIDGET(gtk_builder_get_object(builder, "window"));
+static void build_window(GtkApplication *app) {
+  GtkBuilder *builder =
+      gtk_builder_new_from_resource(RESOURCE_PREFIX "/3dviewer_view.ui");
+  GObject *window = gtk_builder_get_object(builder, "window");
   gtk_window_set_application(GTK_WINDOW(window), app);
+  g_object_set_data(G_OBJECT(app), "window", window);
 
   GObject *gl_area = gtk_builder_get_object(builder, "gl-area");
+  g_object_set_data(G_OBJECT(app), "gl-area", gl_area);
+  g_object_set_data(gl_area, "startup-time",
+                    g_object_get_data(G_OBJECT(app), "startup-time"));
   g_signal_connect(gl_area, "realize", G_CALLBACK(realize), NULL);
   g_signal_connect(gl_area, "unrealize", G_CALLBACK(unrealize), NULL);
   g_signal_connect(gl_area, "render", G_CALLBACK(render), NULL);
 
+  // GTK has switched to the user's locale by now; the settings file and the
+  // status line keep '.' as the decimal point. The model library reads
+  // numbers in its own per-thread locale and does not depend on this.
+  setlocale(LC_NUMERIC, "C");
   static Settings settings = {0};
   load_settings(&settings);
   g_object_set_data(gl_area, "settings", &settings);
@@ -403,8 +1712,60 @@ static void activate(GtkApplication *app) {
   static Model1 model = {0};
   g_object_set_data(gl_area, "model", &model);
 
+  static Topology topology = {0};
+  g_object_set_data(gl_area, "topology", &topology);
+
+  static PointCloud points = {0};
+  g_object_set_data(gl_area, "points", &points);
+
+  static Model1 source = {0};
+  g_object_set_data(gl_area, "source", &source);
+
+  static Matrix transform = {{{0}}};
+  g_object_set_data(gl_area, "transform", &transform);
+  static unsigned int transform_generation = 0;
+  g_object_set_data(gl_area, "transform-generation", &transform_generation);
+  static unsigned int model_generation = 0;
+  g_object_set_data(gl_area, "model-generation", &model_generation);
+
+  static Camera camera;
+  reset_camera(&camera);
+  g_object_set_data(gl_area, "camera", &camera);
+
+  static InputState input = {0};
+  g_object_set_data(gl_area, "input", &input);
+  set_camera_controls(GTK_WIDGET(gl_area));
+
+  static size_t gpu_bytes = 0;
+  g_object_set_data(gl_area, "gpu-bytes", &gpu_bytes);
+
+  static FrameStats frame_stats = {0};
+  g_object_set_data(gl_area, "frame-stats", &frame_stats);
+
+  static CaptureRing capture = {0};
+  g_object_set_data(gl_area, "capture", &capture);
+
+  static Section section = {0};
+  g_object_set_data(gl_area, "section", &section);
+
+  static BoundingSphere sphere = {0};
+  g_object_set_data(gl_area, "sphere", &sphere);
+
   GObject *button_open = gtk_builder_get_object(builder, "button-open");
   g_signal_connect(button_open, "clicked", G_CALLBACK(clicked_open), gl_area);
+  GObject *button_export = gtk_builder_get_object(builder, "button-export");
+  g_signal_connect(button_export, "clicked", G_CALLBACK(clicked_export),
+                   gl_area);
+  GObject *button_fit = gtk_builder_get_object(builder, "button-fit");
+  g_signal_connect(button_fit, "clicked", G_CALLBACK(clicked_fit), gl_area);
+  GObject *button_screenshot =
+      gtk_builder_get_object(builder, "button-screenshot");
+  g_signal_connect(button_screenshot, "clicked",
+                   G_CALLBACK(clicked_screenshot), gl_area);
+  GObject *button_record = gtk_builder_get_object(builder, "button-record");
+  g_object_set_data(gl_area, "button-record", button_record);
+  g_signal_connect(button_record, "toggled", G_CALLBACK(record_toggled),
+                   gl_area);
 
   GObject *button_move = gtk_builder_get_object(builder, "button-move");
   g_signal_connect(button_move, "clicked", G_CALLBACK(clicked), gl_area);
@@ -431,15 +1792,50 @@ static void activate(GtkApplication *app) {
 
   GObject *status = gtk_builder_get_object(builder, "status");
   g_object_set_data(gl_area, "status", status);
+  GObject *fps = gtk_builder_get_object(builder, "fps");
+  g_object_set_data(gl_area, "fps", fps);
+  GObject *memory = gtk_builder_get_object(builder, "memory");
+  g_object_set_data(gl_area, "memory", memory);
 
   set_settings(builder, &settings, gl_area);
   gtk_window_present(GTK_WINDOW(window));
   g_object_unref(builder);
 }
 
+static void activate(GtkApplication *app) {
+  GObject *window = g_object_get_data(G_OBJECT(app), "window");
+
+  if (window)
+    gtk_window_present(GTK_WINDOW(window));
+  else
+    build_window(app);
+}
+
+static void open_files(GApplication *app, GFile **files, int n_files,
+                       const char *hint) {
+  activate(GTK_APPLICATION(app));
+  GObject *gl_area = g_object_get_data(G_OBJECT(app), "gl-area");
+
+  if (n_files > 0) {
+    char *filename = g_file_get_path(files[0]);
+    if (gtk_widget_get_realized(GTK_WIDGET(gl_area))) {
+      open_model(gl_area, filename);
+      g_free(filename);
+    } else {
+      g_object_set_data_full(gl_area, "pending-model", filename, g_free);
+    }
+  }
+}
+
 int main(int argc, char **argv) {
-  GtkApplication *app = gtk_application_new("my.viewer.c", 0);
+  static gint64 startup_time = 0;
+  startup_time = g_get_monotonic_time();
+
+  GtkApplication *app =
+      gtk_application_new(APPLICATION_ID, G_APPLICATION_HANDLES_OPEN);
+  g_object_set_data(G_OBJECT(app), "startup-time", &startup_time);
   g_signal_connect(app, "activate", G_CALLBACK(activate), NULL);
+  g_signal_connect(app, "open", G_CALLBACK(open_files), NULL);
   int status = g_application_run(G_APPLICATION(app), argc, argv);
 
   g_object_unref(app);
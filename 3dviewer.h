@@ -6,6 +6,8 @@
 #include <limits.h>
 #include <locale.h>
 #include <math.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -13,7 +15,74 @@
 enum ERROR_CODES { OK, ERROR };
 #define PI 3.14159265358979323846264338327950288
 #define MAX_LINE_LENGTH 2048
+#define MODEL_ERROR_LENGTH 256
 #define SETTINGS_CONFIG "settings.conf"
+#define PROGRAM_NAME "3dviewer"
+#define APPLICATION_ID "my.viewer.c"
+#define RESOURCE_PREFIX "/my/viewer/c"
+#define STARTUP_BENCH_ENV "VIEWER_STARTUP_BENCH"
+#define CAMERA_FOV 60.0
+#define CAMERA_DISTANCE 1.7320508075688772
+#define CAMERA_NEAR 0.01
+#define CAMERA_FAR 100.0
+#define CAMERA_UNIT_RADIUS 0.8660254037844386
+#define CAMERA_MIN_DISTANCE 0.05
+#define CAMERA_MAX_DISTANCE 50.0
+#define CAMERA_MAX_PITCH 89.0
+#define CAMERA_FIT_MARGIN 1.05
+#define CAMERA_DEPTH_RATIO 0.001
+#define ORBIT_DEGREES_PER_PIXEL 0.4
+#define ZOOM_STEP 1.1
+#define FPS_WINDOW_USEC 500000
+#define FPS_IDLE_USEC 100000
+#define MEGABYTE 1048576.0
+#define VERTEX_UPLOAD_SLICE 4096
+#define SURFACE_COLOR 0.75f, 0.75f, 0.78f, 1.0f
+#define PARALLEL_THREADS_ENV "VIEWER_THREADS"
+#define PARALLEL_MAX_WORKERS 64
+#define EXPORT_BLOCK_SIZE 16384
+#define EXPORT_NUMBER_LENGTH 32
+#define EXPORT_WRITE_BUFFER (1 << 20)
+#define BINARY_MAGIC "3DVB"
+#define BINARY_EXTENSION ".3dvb"
+#define BINARY_BYTE_ORDER 0x01020304u
+#define BINARY_VERSION 1
+#define STL_HEADER_SIZE 80
+#define STL_TRIANGLE_SIZE 50
+#define PLY_NAME_LENGTH 32
+#define PLY_MAX_ELEMENTS 8
+#define PLY_MAX_PROPERTIES 32
+#define PARALLEL_SCAN_CHUNK 65536
+#define PARALLEL_GRAIN 4096
+#define SMALL_BUCKET 16
+#define TOPOLOGY_NONE UINT_MAX
+#define TOPOLOGY_BOUNDARY (UINT_MAX - 1)
+#define TOPOLOGY_NON_MANIFOLD (UINT_MAX - 2)
+#define TOPOLOGY_DEGENERATE (UINT_MAX - 3)
+#define DIFF_MAX_RANGES 32
+#define DIFF_MERGE_GAP 64
+#define DIFF_BLOCK 4096
+#define RELOAD_DELAY_MS 200
+#define POINT_LOD_DEPTH 10
+#define POINT_LEVELS (POINT_LOD_DEPTH + 2)
+#define POINT_RADIX_BITS 10
+#define POINT_SPACING_PIXELS 2.0
+#define POINT_DRAW_BUDGET 2000000
+#define LINE_LOOP_RESTART UINT_MAX
+#define CAPTURE_PBO_COUNT 3
+#define CAPTURE_QUEUE_SIZE 8
+#define CAPTURE_NAME_LENGTH 4096
+#define CAPTURE_IDAT_SIZE (1 << 16)
+#define CAPTURE_POLL_MS 4
+#define CAPTURE_BENCH_ENV "VIEWER_CAPTURE_BENCH"
+#define TURNTABLE_DEGREES_PER_FRAME 3.0
+#define BMP_HEADER_SIZE 54
+#define SECTION_CHUNK 1024
+#define SECTION_COLOR 0.9f, 0.2f, 0.2f, 1.0f
+#define SPHERE_BLOCK 65536
+#define STREAM_CHUNK_SIZE (1 << 20)
+#define STREAM_CHUNK_COUNT 4
+#define STREAM_INPUT_SIZE (1 << 16)
 
 // Structures
 typedef struct model1 {
@@ -22,16 +91,301 @@ typedef struct model1 {
   unsigned int face_count;
   unsigned int *faces;
   unsigned int polygon_count;
-  int *num_vertices_in_polygon;
+  unsigned int polygon_arity;     // corners of every polygon, 0 when mixed
+  unsigned int *polygon_offsets;  // polygon_count + 1 starts in faces, or
+                                  // NULL when polygon_arity is set
   double minMaxX[2];
   double minMaxY[2];
   double minMaxZ[2];
+  size_t memory_bytes;
+  int float_vertices;
+  unsigned int normal_count;
+  float *normals;  // vn lines as read, one per vertex after prepare_shading
+  int normal_index_mismatch;
+  unsigned int triangle_count;
+  unsigned int *triangles;  // 0-based, three per triangle
 } Model1;
 
+// Compact binary form written by export_model_binary: this header followed by
+// the vertices, the corner count of every polygon (int) and the faces array
+// in host byte order.
+typedef struct binary_header {
+  char magic[4];
+  uint32_t byte_order;
+  uint32_t version;
+  uint32_t vertex_count;
+  uint32_t polygon_count;
+  uint32_t face_count;
+} BinaryHeader;
+
+// Changed element ranges found by diff_ranges; close ranges are merged and
+// the last range absorbs everything past DIFF_MAX_RANGES.
+typedef struct range_list {
+  unsigned int count;
+  unsigned int first[DIFF_MAX_RANGES];
+  unsigned int length[DIFF_MAX_RANGES];
+} RangeList;
+
+typedef struct model_diff {
+  int layout_changed;
+  RangeList vertices;
+  RangeList faces;
+} ModelDiff;
+
+typedef enum { FORMAT_OBJ, FORMAT_BINARY, FORMAT_PLY, FORMAT_STL } ModelFormat;
+
+// Library errors are returned to the caller instead of being printed; line
+// is 1-based for text formats and 0 when the error has no line.
+typedef enum {
+  MODEL_ERROR_NONE,
+  MODEL_ERROR_OPEN,
+  MODEL_ERROR_SYNTAX,
+  MODEL_ERROR_INDEX,
+  MODEL_ERROR_FORMAT,
+  MODEL_ERROR_TRUNCATED,
+  MODEL_ERROR_MEMORY,
+  MODEL_ERROR_BUDGET,
+  MODEL_ERROR_WRITE
+} ModelErrorCode;
+
+typedef struct model_error {
+  ModelErrorCode code;
+  unsigned int line;
+  char message[MODEL_ERROR_LENGTH];
+} ModelError;
+
+// Everything one OBJ parse writes to, so parses in several threads share
+// nothing; face_capacity is the size of model->faces.
+typedef struct parse_context {
+  Model1 *model;
+  ModelError *error;
+  unsigned int line;
+  unsigned int vertex_index;
+  unsigned int normal_index;
+  unsigned int normal_capacity;
+  unsigned int face_index;
+  unsigned int face_capacity;
+  unsigned int polygon_index;
+} ParseContext;
+
+// Memory accounting
+typedef enum {
+  MEMORY_MODEL,
+  MEMORY_GPU,
+  MEMORY_STREAM,
+  MEMORY_TOPOLOGY,
+  MEMORY_POINTS,
+  MEMORY_CAPTURE,
+  MEMORY_SECTION,
+  MEMORY_KIND_COUNT
+} MemoryKind;
+
+typedef enum { MEMORY_REFUSE, MEMORY_FLOAT_FALLBACK } MemoryPolicy;
+
+// Half-edge adjacency: half-edge h is the h-th entry of Model1.faces and runs
+// from origin[h] to the origin of the next half-edge of the same polygon.
+// twin is the opposite half-edge or one of the TOPOLOGY_* markers; vertices
+// are 0-based here, unlike in faces.
+typedef struct topology {
+  unsigned int vertex_count;
+  unsigned int polygon_count;
+  unsigned int half_edge_count;
+  unsigned int *origin;
+  unsigned int *twin;
+  unsigned int *polygon;
+  unsigned int *polygon_start;
+  unsigned int *valence;
+  unsigned int *component;
+  unsigned int edge_count;
+  unsigned int boundary_edge_count;
+  unsigned int non_manifold_edge_count;
+  unsigned int component_count;
+  size_t memory_bytes;
+} Topology;
+
+// Models without faces: vertex indices ordered so that every prefix ending
+// at level_start[l + 1] keeps one point per occupied cell of a 2^l voxel
+// grid over the bounding cube; the last level holds points that share a
+// finest cell with an earlier one.
+typedef struct point_cloud {
+  unsigned int point_count;
+  unsigned int *order;
+  unsigned int level_start[POINT_LEVELS + 1];
+  double root_size;
+  size_t memory_bytes;
+} PointCloud;
+
 typedef struct {
   double data[4][4];
 } Matrix;
 
+typedef struct bounding_sphere {
+  double center[3];
+  double radius;
+} BoundingSphere;
+
+// The camera orbits target; near and far bound the depth of the model and
+// radius, of the last fitted sphere, scales the zoom limits.
+typedef struct camera {
+  double yaw;
+  double pitch;
+  double distance;
+  double pan_x;
+  double pan_y;
+  double target[3];
+  double near;
+  double far;
+  double radius;
+} Camera;
+
+// Pending pointer input, applied to the camera once per frame clock tick
+typedef struct input_state {
+  double orbit_x;
+  double orbit_y;
+  double pan_x;
+  double pan_y;
+  double zoom;
+  double last_x;
+  double last_y;
+  unsigned int tick_id;
+} InputState;
+
+typedef struct frame_stats {
+  long long window_start;
+  long long last_frame;
+  unsigned int frames;
+  double fps;
+  double frame_ms;
+} FrameStats;
+
+// One background reload: source_old is moved in from the viewer and either
+// replaced by source or handed back when the result is discarded.
+typedef struct reload_job {
+  char *filename;
+  unsigned int model_generation;
+  unsigned int transform_generation;
+  Matrix transform;
+  Model1 source_old;
+  Model1 source;
+  Model1 display;
+  Topology topology;
+  PointCloud points;
+  BoundingSphere sphere;
+  ModelDiff diff;
+  int error_code;
+  ModelError error;
+} ReloadJob;
+
+// Section plane: polygons are grouped in chunks of SECTION_CHUNK in file
+// order and every chunk keeps the bounding box of its corners, min xyz then
+// max xyz, so a plane only visits the chunks it crosses.
+typedef struct section_index {
+  double *bounds;
+  unsigned int chunk_count;
+  size_t memory_bytes;
+} SectionIndex;
+
+// Cross-section outline: two xyz float points per segment, drawn as lines.
+typedef struct section_lines {
+  float *points;
+  unsigned int segment_count;
+  unsigned int capacity;
+  size_t memory_bytes;
+} SectionLines;
+
+// position runs from 0 to 1 across the model along axis.
+typedef struct section {
+  int enabled;
+  int axis;
+  double position;
+  int index_dirty;
+  int lines_dirty;
+  double plane[4];  // set with the lines, used to clip the model
+  SectionIndex index;
+  SectionLines lines;
+} Section;
+
+// Capture
+typedef enum { IMAGE_PNG, IMAGE_BMP } ImageFormat;
+
+// One frame read back from the GL area: RGBA rows, bottom row first, as
+// glReadPixels returns them.
+typedef struct capture_frame {
+  unsigned char *pixels;
+  unsigned int width;
+  unsigned int height;
+  char filename[CAPTURE_NAME_LENGTH];
+} CaptureFrame;
+
+typedef struct capture_stats {
+  unsigned int written;
+  unsigned int dropped;
+  unsigned int failed;
+  unsigned int pending;
+} CaptureStats;
+
+// Bounded queue between the render loop and the encoder thread.
+typedef struct capture_queue {
+  CaptureFrame frames[CAPTURE_QUEUE_SIZE];
+  unsigned int head;
+  unsigned int tail;
+  unsigned int filled;
+  int encoding;
+  int closing;
+  int running;
+  CaptureStats stats;
+  pthread_mutex_t mutex;
+  pthread_cond_t not_empty;
+  pthread_t thread;
+} CaptureQueue;
+
+// Frames are copied into a ring of pixel buffer objects and mapped only once
+// their fence has signalled, so glReadPixels never waits for the GPU.
+// fence holds GLsync values; this header does not include OpenGL.
+typedef struct capture_ring {
+  unsigned int pbo[CAPTURE_PBO_COUNT];
+  size_t capacity[CAPTURE_PBO_COUNT];
+  void *fence[CAPTURE_PBO_COUNT];
+  CaptureFrame frame[CAPTURE_PBO_COUNT];
+  unsigned int next;
+  unsigned int poll_id;
+  unsigned int tick_id;
+  char screenshot[CAPTURE_NAME_LENGTH];
+  char record_base[CAPTURE_NAME_LENGTH];
+  unsigned int record_frames;
+  unsigned int record_index;
+  long long record_start;
+  double record_fps;
+  CaptureQueue queue;
+} CaptureRing;
+
+// Streaming
+typedef enum { COMPRESSION_NONE, COMPRESSION_GZIP, COMPRESSION_ZSTD } Compression;
+
+typedef struct stream_chunk {
+  char *data;
+  size_t size;
+} StreamChunk;
+
+typedef struct stream_reader {
+  FILE *file;
+  Compression compression;
+  StreamChunk chunks[STREAM_CHUNK_COUNT];
+  unsigned int head;
+  unsigned int tail;
+  unsigned int filled;
+  StreamChunk *current;
+  size_t position;
+  int finished;
+  int cancelled;
+  int error_code;
+  ModelError error;
+  pthread_mutex_t mutex;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  pthread_t thread;
+} StreamReader;
+
 // Settings
 typedef enum { PARALLEL_PROJECTION, CENTRAL_PROJECTION } ProjectionType;
 
@@ -39,6 +393,12 @@ typedef enum { SOLID_EDGE, DASHED_EDGE } EdgeType;
 
 typedef enum { NONE_EDGE, CIRCLE_EDGE, SQUARE_EDGE } EdgeDisplayMethod;
 
+typedef enum {
+  DISPLAY_WIREFRAME,
+  DISPLAY_SHADED,
+  DISPLAY_SHADED_WIREFRAME
+} DisplayMode;
+
 typedef struct color_rgba {
   float red;
   float green;
@@ -55,22 +415,149 @@ typedef struct settings {
   ColorRGBA vertex_color;
   double vertex_size;
   ColorRGBA background_color;
+  double memory_budget;
+  MemoryPolicy memory_policy;
+  DisplayMode display_mode;
+  int auto_reload;
 } Settings;
 
 // Parser
 void *memory_allocation(size_t size, const char *error_msg);
-void replace_decimal_separator(char *str);
+void *parser_allocation(size_t size, const char *what, ModelError *error);
+void clear_model_error(ModelError *error);
+void set_model_error(ModelError *error, ModelErrorCode code, unsigned int line,
+                     const char *format, ...);
+int format_model_error(const ModelError *error, char *buffer, size_t size);
 int load_model(const char *filename, Model1 *model);
-int get_model_data(FILE *file, Model1 *model);
+int load_model_with_error(const char *filename, Model1 *model,
+                          ModelError *error);
+int get_model_data(FILE *file, Model1 *model, ModelError *error);
 void free_model(Model1 *model);
 void read_line(FILE *file, char **line);
 void replace_decimal_separator(char *str);
-int parse_file(FILE *file, char *line, unsigned int *capability, Model1 *model);
-int parse_vertices(char *line, unsigned int *vertex_index, Model1 *model);
-int parse_faces(char *line, unsigned int *capability, Model1 *model,
-                unsigned int *face_index, unsigned int *polygon_index);
+int parse_file(FILE *file, char *line, ParseContext *context);
+int parse_vertices(ParseContext *context, char *line);
+int parse_normals(ParseContext *context, char *line);
+int parse_faces(ParseContext *context, char *line);
 int count_vertices_faces(char *line, FILE *file, unsigned int *vertex_count,
                          unsigned int *face_count);
+void init_bounds(Model1 *model);
+void update_bounds(Model1 *model, const double *vertex);
+int reserve_buffer(void **buffer, unsigned int *capacity, unsigned int needed,
+                   size_t element_size, ModelError *error);
+
+// Polygons
+unsigned int polygon_start(const Model1 *model, unsigned int polygon);
+unsigned int polygon_size(const Model1 *model, unsigned int polygon);
+void compact_polygons(Model1 *model);
+unsigned int line_loop_count(const Model1 *model);
+void build_line_loops(const Model1 *model, unsigned int *indices);
+unsigned int polygon_of_face(const Model1 *model, unsigned int face);
+unsigned int line_loop_position(const Model1 *model, unsigned int face);
+void build_line_loop_span(const Model1 *model, unsigned int first,
+                          unsigned int last, unsigned int *indices);
+
+// Memory
+void memory_track(MemoryKind kind, long long delta);
+size_t memory_current(void);
+size_t memory_usage_of(MemoryKind kind);
+size_t memory_peak(void);
+void memory_reset_peak(void);
+void set_memory_budget(size_t bytes, MemoryPolicy policy);
+size_t get_memory_budget(void);
+MemoryPolicy get_memory_policy(void);
+int memory_budget_allows(size_t additional);
+void update_model_memory(Model1 *model, size_t bytes);
+size_t estimate_gpu_bytes(unsigned int vertex_count, unsigned int index_count,
+                          int float_vertices);
+int check_memory_budget(const char *what, size_t model_bytes,
+                        unsigned int vertex_count, unsigned int index_count,
+                        int *float_vertices, ModelError *error);
+
+// Parallel loops: task runs on [begin, end) ranges, one per worker
+typedef void (*ParallelTask)(void *context, size_t begin, size_t end,
+                             unsigned int worker);
+unsigned int parallel_worker_count(void);
+unsigned int parallel_for(size_t count, size_t min_chunk, ParallelTask task,
+                          void *context);
+int parallel_exclusive_scan(unsigned int *values, size_t count);
+
+// Topology
+int build_topology(const Model1 *model, Topology *topology,
+                   ModelError *error);
+void free_topology(Topology *topology);
+unsigned int topology_next(const Topology *topology, unsigned int half_edge);
+unsigned int topology_prev(const Topology *topology, unsigned int half_edge);
+unsigned int topology_destination(const Topology *topology,
+                                  unsigned int half_edge);
+int topology_is_closed(const Topology *topology);
+
+// Shading
+int triangulate_model(Model1 *model);
+int compute_normals(Model1 *model);
+int prepare_shading(Model1 *model, ModelError *error);
+
+// Point cloud
+unsigned int morton_code(unsigned int x, unsigned int y, unsigned int z);
+int build_point_cloud(const Model1 *model, PointCloud *cloud,
+                      ModelError *error);
+void free_point_cloud(PointCloud *cloud);
+unsigned int point_cloud_draw_count(const PointCloud *cloud, double pixel_size,
+                                    unsigned int max_points);
+
+// Reload
+void diff_ranges(const void *old_data, const void *new_data,
+                 unsigned int count, size_t element_size, RangeList *ranges);
+void diff_models(const Model1 *old_model, const Model1 *new_model,
+                 ModelDiff *diff);
+int copy_model(const Model1 *source, Model1 *copy, ModelError *error);
+
+// Export
+int format_double(double value, char *buffer);
+int export_model_obj(const char *filename, const Model1 *model,
+                     ModelError *error);
+int export_model_binary(const char *filename, const Model1 *model,
+                        ModelError *error);
+int load_binary_model(const char *filename, Model1 *model, ModelError *error);
+
+// Import
+ModelFormat detect_model_format(const char *filename);
+int load_ply_model(const char *filename, Model1 *model, ModelError *error);
+int load_stl_model(const char *filename, Model1 *model, ModelError *error);
+
+// Section plane
+int build_section_index(const Model1 *model, SectionIndex *index);
+void free_section_index(SectionIndex *index);
+int compute_section(const Model1 *model, const SectionIndex *index,
+                    const double plane[4], SectionLines *lines);
+void free_section_lines(SectionLines *lines);
+void section_plane(int axis, double offset, double plane[4]);
+void section_extent(const SectionIndex *index, int axis, double extent[2]);
+
+// Bounding sphere
+int bounding_sphere(const Model1 *model, BoundingSphere *sphere);
+void transform_sphere(BoundingSphere *sphere, Matrix matrix);
+
+// Capture
+ImageFormat detect_image_format(const char *filename);
+int write_image(const char *filename, const unsigned char *pixels,
+                unsigned int width, unsigned int height);
+void capture_frame_name(const char *base, unsigned int index, char *name,
+                        size_t size);
+int capture_open(CaptureQueue *queue);
+int capture_push(CaptureQueue *queue, CaptureFrame *frame);
+CaptureStats capture_stats(CaptureQueue *queue);
+void capture_close(CaptureQueue *queue);
+
+// Compressed input
+Compression detect_compression(const char *filename);
+int load_compressed_model(const char *filename, Compression compression,
+                          Model1 *model, ModelError *error);
+int stream_open(StreamReader *reader, const char *filename,
+                Compression compression, ModelError *error);
+void stream_close(StreamReader *reader);
+void stream_read_line(StreamReader *reader, char **line);
+int parse_stream(StreamReader *reader, char *line, ParseContext *context);
 
 // Transfotmation
 double convert_to_radian(double angle);
@@ -82,8 +569,30 @@ Matrix create_rotation_matrix_y(double angle);
 Matrix create_rotation_matrix_z(double angle);
 Matrix create_scale_matrix(double scale);
 void modify_model(Model1 *model, Matrix matrix);
-void translate_to_origin(Model1 *model);
-void scale1(Model1 *model);
+Matrix translate_to_origin(Model1 *model);
+Matrix scale1(Model1 *model);
+Matrix mult_matrices(Matrix left, Matrix right);
+double transform_scale(Matrix matrix);
+void matrix_to_float(Matrix matrix, float result[16]);
+
+// Camera
+void reset_camera(Camera *camera);
+void orbit_camera(Camera *camera, double yaw, double pitch);
+void pan_camera(Camera *camera, double x, double y);
+void zoom_camera(Camera *camera, double factor);
+double camera_half_height(const Camera *camera);
+void fit_camera(Camera *camera, const BoundingSphere *sphere, double aspect);
+void fit_clip_planes(Camera *camera, const BoundingSphere *sphere);
+Matrix create_view_matrix(const Camera *camera);
+Matrix create_perspective_matrix(double fov, double aspect, double near,
+                                 double far);
+Matrix create_orthographic_matrix(double half_width, double half_height,
+                                  double near, double far);
+Matrix create_projection_matrix(const Camera *camera, ProjectionType type,
+                                double aspect);
+
+// Shaders
+unsigned int load_shader_program(const char *name);
 
 // Settings
 void save_settings(const Settings *settings);
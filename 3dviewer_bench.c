@@ -0,0 +1,87 @@
+#include <time.h>
+
+#include "3dviewer.h"
+
+static double elapsed_ms(const struct timespec *start) {
+  struct timespec now;
+  timespec_get(&now, TIME_UTC);
+  return (now.tv_sec - start->tv_sec) * 1000.0 +
+         (now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+static void bench_model(const char *filename) {
+  Model1 model = {0};
+  struct timespec start;
+
+  memory_reset_peak();
+  timespec_get(&start, TIME_UTC);
+  ModelError error;
+  int error_code = load_model_with_error(filename, &model, &error);
+  double load_ms = elapsed_ms(&start);
+
+  if (error_code == OK) {
+    printf("%-28s %9.2f ms %10u vertices %10u polygons %8.1f MB model "
+           "%8.1f MB peak%s\n",
+           filename, load_ms, model.vertex_count, model.polygon_count,
+           model.memory_bytes / MEGABYTE, memory_peak() / MEGABYTE,
+           model.float_vertices ? " (float GPU fallback)" : "");
+
+    Topology topology = {0};
+    timespec_get(&start, TIME_UTC);
+    if (build_topology(&model, &topology, NULL) == OK) {
+      printf("%-28s %9.2f ms topology: %u edges, %u boundary, "
+             "%u non-manifold, %u components\n",
+             "", elapsed_ms(&start), topology.edge_count,
+             topology.boundary_edge_count, topology.non_manifold_edge_count,
+             topology.component_count);
+    }
+    free_topology(&topology);
+
+    timespec_get(&start, TIME_UTC);
+    if (prepare_shading(&model, NULL) == OK) {
+      printf("%-28s %9.2f ms shading: %u triangles\n", "",
+             elapsed_ms(&start), model.triangle_count);
+    }
+
+    PointCloud points = {0};
+    timespec_get(&start, TIME_UTC);
+    if (build_point_cloud(&model, &points, NULL) == OK) {
+      printf("%-28s %9.2f ms point cloud: %u points, %u distinct cells\n",
+             "", elapsed_ms(&start), points.point_count,
+             points.level_start[POINT_LEVELS - 1]);
+    }
+    free_point_cloud(&points);
+  } else {
+    char message[MODEL_ERROR_LENGTH + 32];
+    format_model_error(&error, message, sizeof(message));
+    printf("%-28s %9.2f ms refused or failed, peak %.1f MB\n", filename,
+           load_ms, memory_peak() / MEGABYTE);
+    fprintf(stderr, "%s: %s\n", filename, message);
+  }
+
+  free_model(&model);
+}
+
+int main(int argc, char **argv) {
+  int error_code = OK;
+  int first = 1;
+
+  if (argc > 2 && strcmp(argv[1], "--budget") == 0) {
+    set_memory_budget(atof(argv[2]) * MEGABYTE, MEMORY_FLOAT_FALLBACK);
+    first = 3;
+  }
+
+  if (first >= argc) {
+    fprintf(stderr, "Usage: %s [--budget MB] model.obj...\n", argv[0]);
+    error_code = ERROR;
+  }
+
+  // Failed loads are reported in the table; only usage errors fail the run.
+  for (int i = first; i < argc; i++) {
+    bench_model(argv[i]);
+  }
+
+  printf("Memory now %.1f MB, budget %.1f MB\n", memory_current() / MEGABYTE,
+         get_memory_budget() / MEGABYTE);
+  return error_code;
+}
@@ -0,0 +1,141 @@
+#include "3dviewer.h"
+
+void reset_camera(Camera *camera) {
+  camera->yaw = 0.0;
+  camera->pitch = 0.0;
+  camera->distance = CAMERA_DISTANCE;
+  camera->pan_x = 0.0;
+  camera->pan_y = 0.0;
+  memset(camera->target, 0, sizeof(camera->target));
+  camera->near = CAMERA_NEAR;
+  camera->far = CAMERA_FAR;
+  camera->radius = CAMERA_UNIT_RADIUS;
+}
+
+void orbit_camera(Camera *camera, double yaw, double pitch) {
+  camera->yaw = fmod(camera->yaw + yaw, 360.0);
+  camera->pitch += pitch;
+
+  if (camera->pitch > CAMERA_MAX_PITCH) camera->pitch = CAMERA_MAX_PITCH;
+  if (camera->pitch < -CAMERA_MAX_PITCH) camera->pitch = -CAMERA_MAX_PITCH;
+}
+
+void pan_camera(Camera *camera, double x, double y) {
+  camera->pan_x += x;
+  camera->pan_y += y;
+}
+
+// The limits are given for the unit model and scale with the radius of the
+// last fitted sphere, so a tiny or huge model zooms the same way.
+void zoom_camera(Camera *camera, double factor) {
+  double scale = camera->radius / CAMERA_UNIT_RADIUS;
+
+  if (factor > 0) {
+    camera->distance *= factor;
+  }
+
+  if (camera->distance < CAMERA_MIN_DISTANCE * scale) {
+    camera->distance = CAMERA_MIN_DISTANCE * scale;
+  }
+  if (camera->distance > CAMERA_MAX_DISTANCE * scale) {
+    camera->distance = CAMERA_MAX_DISTANCE * scale;
+  }
+}
+
+// Half of the visible height at the orbit target; parallel projection uses it
+// so that both projections frame the model the same way.
+double camera_half_height(const Camera *camera) {
+  return camera->distance * tan(convert_to_radian(CAMERA_FOV) / 2);
+}
+
+Matrix create_view_matrix(const Camera *camera) {
+  Matrix matrix = create_translation_matrix(camera->pan_x, camera->pan_y,
+                                            -camera->distance);
+  matrix = mult_matrices(matrix, create_rotation_matrix_x(camera->pitch));
+  matrix = mult_matrices(matrix, create_rotation_matrix_y(camera->yaw));
+  matrix = mult_matrices(
+      matrix, create_translation_matrix(-camera->target[0],
+                                        -camera->target[1],
+                                        -camera->target[2]));
+  return matrix;
+}
+
+// Looks at the center of the sphere from the current direction, close
+// enough that the sphere fills the narrower side of the view. The sphere
+// fits whatever the orientation, unlike a box.
+void fit_camera(Camera *camera, const BoundingSphere *sphere, double aspect) {
+  double half_fov = convert_to_radian(CAMERA_FOV) / 2;
+
+  if (aspect > 0 && aspect < 1) half_fov = atan(tan(half_fov) * aspect);
+  memcpy(camera->target, sphere->center, sizeof(camera->target));
+  camera->pan_x = 0.0;
+  camera->pan_y = 0.0;
+  if (sphere->radius > 0) {
+    camera->distance = sphere->radius * CAMERA_FIT_MARGIN / sin(half_fov);
+    camera->radius = sphere->radius;
+  }
+  fit_clip_planes(camera, sphere);
+}
+
+// Near and far planes hug the sphere at its current depth, which keeps depth
+// precision for small models and stops large ones from being cut off.
+void fit_clip_planes(Camera *camera, const BoundingSphere *sphere) {
+  double center[4] = {sphere->center[0], sphere->center[1], sphere->center[2],
+                      1.0};
+  double view_center[4] = {0};
+  double radius = sphere->radius * CAMERA_FIT_MARGIN;
+
+  mult_matrix(create_view_matrix(camera), center, view_center);
+  double depth = -view_center[2];
+
+  if (radius > 0 && depth + radius > 0) {
+    camera->far = depth + radius;
+    camera->near = fmax(depth - radius, camera->far * CAMERA_DEPTH_RATIO);
+  } else {
+    camera->near = CAMERA_NEAR;
+    camera->far = CAMERA_FAR;
+  }
+}
+
+Matrix create_perspective_matrix(double fov, double aspect, double near,
+                                 double far) {
+  Matrix matrix = create_identity_matrix();
+  double f = 1.0 / tan(convert_to_radian(fov) / 2);
+
+  matrix.data[0][0] = f / aspect;
+  matrix.data[1][1] = f;
+  matrix.data[2][2] = (far + near) / (near - far);
+  matrix.data[2][3] = 2 * far * near / (near - far);
+  matrix.data[3][2] = -1;
+  matrix.data[3][3] = 0;
+
+  return matrix;
+}
+
+Matrix create_orthographic_matrix(double half_width, double half_height,
+                                  double near, double far) {
+  Matrix matrix = create_identity_matrix();
+
+  matrix.data[0][0] = 1 / half_width;
+  matrix.data[1][1] = 1 / half_height;
+  matrix.data[2][2] = -2 / (far - near);
+  matrix.data[2][3] = -(far + near) / (far - near);
+
+  return matrix;
+}
+
+Matrix create_projection_matrix(const Camera *camera, ProjectionType type,
+                                double aspect) {
+  Matrix matrix;
+
+  if (type == PARALLEL_PROJECTION) {
+    double half_height = camera_half_height(camera);
+    matrix = create_orthographic_matrix(half_height * aspect, half_height,
+                                        camera->near, camera->far);
+  } else {
+    matrix = create_perspective_matrix(CAMERA_FOV, aspect, camera->near,
+                                       camera->far);
+  }
+
+  return matrix;
+}
@@ -0,0 +1,309 @@
+#include <zlib.h>
+
+#include "3dviewer.h"
+
+static void put_u16_le(unsigned char *out, unsigned int value) {
+  out[0] = value & 0xff;
+  out[1] = (value >> 8) & 0xff;
+}
+
+static void put_u32_le(unsigned char *out, unsigned int value) {
+  put_u16_le(out, value & 0xffff);
+  put_u16_le(out + 2, value >> 16);
+}
+
+static void put_u32_be(unsigned char *out, unsigned int value) {
+  out[0] = (value >> 24) & 0xff;
+  out[1] = (value >> 16) & 0xff;
+  out[2] = (value >> 8) & 0xff;
+  out[3] = value & 0xff;
+}
+
+// Rows are stored bottom-up in BMP as in OpenGL, so they are written in the
+// order they were read back, as BGR padded to four bytes.
+static int write_bmp(FILE *file, const unsigned char *pixels,
+                     unsigned int width, unsigned int height) {
+  int error_code = OK;
+  size_t row_size = ((size_t)width * 3 + 3) & ~(size_t)3;
+  unsigned char header[BMP_HEADER_SIZE] = {'B', 'M'};
+  unsigned char *row = memory_allocation(row_size, "BMP row");
+
+  put_u32_le(header + 2, BMP_HEADER_SIZE + row_size * height);
+  put_u32_le(header + 10, BMP_HEADER_SIZE);
+  put_u32_le(header + 14, 40);
+  put_u32_le(header + 18, width);
+  put_u32_le(header + 22, height);
+  put_u16_le(header + 26, 1);
+  put_u16_le(header + 28, 24);
+  put_u32_le(header + 34, row_size * height);
+
+  if (row == NULL || fwrite(header, sizeof(header), 1, file) != 1) {
+    error_code = ERROR;
+  }
+  for (unsigned int y = 0; y < height && error_code == OK; y++) {
+    const unsigned char *source = pixels + (size_t)y * width * 4;
+    memset(row, 0, row_size);
+    for (unsigned int x = 0; x < width; x++) {
+      row[3 * x] = source[4 * x + 2];
+      row[3 * x + 1] = source[4 * x + 1];
+      row[3 * x + 2] = source[4 * x];
+    }
+    if (fwrite(row, row_size, 1, file) != 1) error_code = ERROR;
+  }
+
+  free(row);
+  return error_code;
+}
+
+static int write_png_chunk(FILE *file, const char *type,
+                           const unsigned char *data, unsigned int length) {
+  unsigned char header[8];
+  unsigned char footer[4];
+  uLong crc = crc32(0, (const Bytef *)type, 4);
+
+  put_u32_be(header, length);
+  memcpy(header + 4, type, 4);
+  if (length > 0) crc = crc32(crc, data, length);
+  put_u32_be(footer, crc);
+
+  return fwrite(header, sizeof(header), 1, file) == 1 &&
+                 (length == 0 || fwrite(data, length, 1, file) == 1) &&
+                 fwrite(footer, sizeof(footer), 1, file) == 1
+             ? OK
+             : ERROR;
+}
+
+// RGB rows, top row first, each with the Sub filter; the deflate stream is
+// written in CAPTURE_IDAT_SIZE chunks as it is produced, so the encoder
+// never holds more than one row and one chunk besides the frame.
+static int write_png(FILE *file, const unsigned char *pixels,
+                     unsigned int width, unsigned int height) {
+  static const unsigned char signature[8] = {0x89, 'P',  'N',  'G',
+                                             '\r', '\n', 0x1a, '\n'};
+  int error_code = OK;
+  size_t row_size = (size_t)width * 3 + 1;
+  unsigned char header[13] = {0};
+  unsigned char *row = memory_allocation(row_size, "PNG row");
+  unsigned char *chunk = memory_allocation(CAPTURE_IDAT_SIZE, "PNG chunk");
+  z_stream zs = {0};
+
+  put_u32_be(header, width);
+  put_u32_be(header + 4, height);
+  header[8] = 8;
+  header[9] = 2;
+
+  if (row == NULL || chunk == NULL ||
+      deflateInit(&zs, Z_BEST_SPEED) != Z_OK) {
+    error_code = ERROR;
+  } else if (fwrite(signature, sizeof(signature), 1, file) != 1 ||
+             write_png_chunk(file, "IHDR", header, sizeof(header)) != OK) {
+    error_code = ERROR;
+  }
+
+  zs.next_out = chunk;
+  zs.avail_out = CAPTURE_IDAT_SIZE;
+  for (unsigned int y = 0; y <= height && error_code == OK; y++) {
+    int flush = y == height ? Z_FINISH : Z_NO_FLUSH;
+    int status = Z_OK;
+
+    if (y < height) {
+      const unsigned char *source =
+          pixels + (size_t)(height - 1 - y) * width * 4;
+      row[0] = 1;
+      for (unsigned int x = 0; x < width; x++) {
+        for (int c = 0; c < 3; c++) {
+          unsigned char left = x > 0 ? source[4 * (x - 1) + c] : 0;
+          row[1 + 3 * x + c] = source[4 * x + c] - left;
+        }
+      }
+      zs.next_in = row;
+      zs.avail_in = row_size;
+    }
+
+    do {
+      status = deflate(&zs, flush);
+      if (zs.avail_out == 0 || (status == Z_STREAM_END &&
+                                zs.avail_out < CAPTURE_IDAT_SIZE)) {
+        error_code = write_png_chunk(file, "IDAT", chunk,
+                                     CAPTURE_IDAT_SIZE - zs.avail_out);
+        zs.next_out = chunk;
+        zs.avail_out = CAPTURE_IDAT_SIZE;
+      }
+    } while (error_code == OK && status == Z_OK &&
+             (zs.avail_in > 0 || flush == Z_FINISH));
+    if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR) {
+      error_code = ERROR;
+    }
+  }
+
+  if (error_code == OK) error_code = write_png_chunk(file, "IEND", NULL, 0);
+  if (zs.state != NULL) deflateEnd(&zs);
+  free(row);
+  free(chunk);
+  return error_code;
+}
+
+ImageFormat detect_image_format(const char *filename) {
+  size_t length = strlen(filename);
+  const char *extension = length >= 4 ? filename + length - 4 : filename;
+  ImageFormat format = IMAGE_PNG;
+
+  if (tolower((unsigned char)extension[1]) == 'b' &&
+      tolower((unsigned char)extension[2]) == 'm' &&
+      tolower((unsigned char)extension[3]) == 'p' && extension[0] == '.') {
+    format = IMAGE_BMP;
+  }
+
+  return format;
+}
+
+// pixels are RGBA rows, bottom row first, as glReadPixels returns them; the
+// format follows the file extension and is PNG unless it is .bmp.
+int write_image(const char *filename, const unsigned char *pixels,
+                unsigned int width, unsigned int height) {
+  int error_code = OK;
+  FILE *file = fopen(filename, "wb");
+
+  if (file == NULL) {
+    error_code = ERROR;
+  } else {
+    error_code = detect_image_format(filename) == IMAGE_BMP
+                     ? write_bmp(file, pixels, width, height)
+                     : write_png(file, pixels, width, height);
+    if (fclose(file) != 0) error_code = ERROR;
+    if (error_code != OK) remove(filename);
+  }
+
+  return error_code;
+}
+
+// "turntable.png" becomes "turntable_0007.png" for frame 7; a name without
+// an extension gets ".png".
+void capture_frame_name(const char *base, unsigned int index, char *name,
+                        size_t size) {
+  const char *dot = strrchr(base, '.');
+  const char *slash = strrchr(base, '/');
+
+  if (dot == NULL || (slash != NULL && dot < slash)) {
+    snprintf(name, size, "%s_%04u.png", base, index);
+  } else {
+    snprintf(name, size, "%.*s_%04u%s", (int)(dot - base), base, index, dot);
+  }
+}
+
+static void *capture_worker(void *arg) {
+  CaptureQueue *queue = arg;
+  int done = 0;
+
+  while (!done) {
+    CaptureFrame frame = {0};
+
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->filled == 0 && !queue->closing) {
+      pthread_cond_wait(&queue->not_empty, &queue->mutex);
+    }
+    if (queue->filled > 0) {
+      frame = queue->frames[queue->head];
+      queue->head = (queue->head + 1) % CAPTURE_QUEUE_SIZE;
+      queue->filled -= 1;
+      queue->encoding = 1;
+    } else {
+      done = 1;
+    }
+    pthread_mutex_unlock(&queue->mutex);
+
+    if (!done) {
+      int error_code =
+          write_image(frame.filename, frame.pixels, frame.width, frame.height);
+      free(frame.pixels);
+      memory_track(MEMORY_CAPTURE,
+                   -(long long)frame.width * frame.height * 4);
+
+      pthread_mutex_lock(&queue->mutex);
+      queue->encoding = 0;
+      if (error_code == OK)
+        queue->stats.written++;
+      else
+        queue->stats.failed++;
+      pthread_mutex_unlock(&queue->mutex);
+    }
+  }
+
+  return NULL;
+}
+
+int capture_open(CaptureQueue *queue) {
+  int error_code = OK;
+
+  memset(queue, 0, sizeof(*queue));
+  pthread_mutex_init(&queue->mutex, NULL);
+  pthread_cond_init(&queue->not_empty, NULL);
+  if (pthread_create(&queue->thread, NULL, capture_worker, queue) != 0) {
+    pthread_mutex_destroy(&queue->mutex);
+    pthread_cond_destroy(&queue->not_empty);
+    error_code = ERROR;
+  } else {
+    queue->running = 1;
+  }
+
+  return error_code;
+}
+
+// Never waits for the encoder: the queue owns frame->pixels from here on,
+// and a frame that finds the queue full is freed and counted as dropped.
+int capture_push(CaptureQueue *queue, CaptureFrame *frame) {
+  int error_code = ERROR;
+
+  // running only changes in capture_open and capture_close, on this thread.
+  if (queue->running) {
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->filled == CAPTURE_QUEUE_SIZE) {
+      queue->stats.dropped++;
+    } else {
+      queue->frames[queue->tail] = *frame;
+      queue->tail = (queue->tail + 1) % CAPTURE_QUEUE_SIZE;
+      queue->filled += 1;
+      memory_track(MEMORY_CAPTURE,
+                   (long long)frame->width * frame->height * 4);
+      pthread_cond_signal(&queue->not_empty);
+      error_code = OK;
+    }
+    pthread_mutex_unlock(&queue->mutex);
+  } else {
+    queue->stats.dropped++;
+  }
+
+  if (error_code != OK) free(frame->pixels);
+  frame->pixels = NULL;
+  return error_code;
+}
+
+CaptureStats capture_stats(CaptureQueue *queue) {
+  CaptureStats stats;
+
+  if (queue->running) {
+    pthread_mutex_lock(&queue->mutex);
+    stats = queue->stats;
+    stats.pending = queue->filled + queue->encoding;
+    pthread_mutex_unlock(&queue->mutex);
+  } else {
+    stats = queue->stats;
+  }
+
+  return stats;
+}
+
+// Frames already queued are still written before the encoder stops.
+void capture_close(CaptureQueue *queue) {
+  if (queue->running) {
+    pthread_mutex_lock(&queue->mutex);
+    queue->closing = 1;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_mutex_unlock(&queue->mutex);
+    pthread_join(queue->thread, NULL);
+
+    pthread_mutex_destroy(&queue->mutex);
+    pthread_cond_destroy(&queue->not_empty);
+  }
+  memset(queue, 0, sizeof(*queue));
+}
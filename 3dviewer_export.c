@@ -0,0 +1,424 @@
+#include "3dviewer.h"
+
+static const double powers_of_ten[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                       1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                       1e12, 1e13, 1e14, 1e15, 1e16, 1e17};
+
+static int format_uint(unsigned long long value, char *buffer) {
+  char digits[24];
+  int length = 0;
+
+  do {
+    digits[length++] = (char)('0' + value % 10);
+    value /= 10;
+  } while (value);
+
+  for (int i = 0; i < length; i++) {
+    buffer[i] = digits[length - 1 - i];
+  }
+  return length;
+}
+
+// Writes the shortest fixed-point decimal that reads back as exactly `value`.
+// For d decimals the candidate is i / 10^d with i and 10^d exact doubles, so
+// the correctly rounded division equals what strtod returns for that text.
+// Values without such a form (huge, tiny, non-finite) use %.17g.
+int format_double(double value, char *buffer) {
+  int length = 0;
+  int found = 0;
+
+  if (value == 0) {
+    length = signbit(value) ? 2 : 1;
+    memcpy(buffer, "-0", 2);
+    if (length == 1) buffer[0] = '0';
+    found = 1;
+  }
+
+  for (int decimals = 0; !found && isfinite(value) && decimals <= 17;
+       decimals++) {
+    double scaled = fabs(value) * powers_of_ten[decimals];
+    if (scaled >= 9007199254740992.0) break;
+
+    unsigned long long digits = (unsigned long long)llround(scaled);
+    if ((double)digits / powers_of_ten[decimals] == fabs(value)) {
+      char text[24];
+      int count = format_uint(digits, text);
+
+      if (signbit(value)) buffer[length++] = '-';
+      if (count <= decimals) {
+        buffer[length++] = '0';
+        buffer[length++] = '.';
+        for (int i = count; i < decimals; i++) buffer[length++] = '0';
+        memcpy(buffer + length, text, count);
+        length += count;
+      } else {
+        memcpy(buffer + length, text, count - decimals);
+        length += count - decimals;
+        if (decimals > 0) {
+          buffer[length++] = '.';
+          memcpy(buffer + length, text + count - decimals, decimals);
+          length += decimals;
+        }
+      }
+      found = 1;
+    }
+  }
+
+  if (!found) {
+    length = snprintf(buffer, EXPORT_NUMBER_LENGTH, "%.17g", value);
+    replace_decimal_separator(buffer);
+  }
+
+  buffer[length] = '\0';
+  return length;
+}
+
+typedef struct export_job {
+  const Model1 *model;
+  size_t first_block;
+  size_t block_count;
+  char **buffers;
+  size_t *sizes;
+} ExportJob;
+
+static void format_vertex_blocks(void *context, size_t begin, size_t end,
+                                 unsigned int worker) {
+  ExportJob *job = context;
+  (void)worker;
+
+  for (size_t slot = begin; slot < end; slot++) {
+    size_t block = job->first_block + slot;
+    unsigned int first = block * EXPORT_BLOCK_SIZE;
+    unsigned int last = first + EXPORT_BLOCK_SIZE;
+    if (last > job->model->vertex_count) last = job->model->vertex_count;
+
+    char *ptr = job->buffers[slot];
+    for (unsigned int i = first; i < last; i++) {
+      *ptr++ = 'v';
+      for (int axis = 0; axis < 3; axis++) {
+        *ptr++ = ' ';
+        ptr += format_double(job->model->vertices[i * 3 + axis], ptr);
+      }
+      *ptr++ = '\n';
+    }
+    job->sizes[slot] = ptr - job->buffers[slot];
+  }
+}
+
+static void format_face_blocks(void *context, size_t begin, size_t end,
+                               unsigned int worker) {
+  ExportJob *job = context;
+  (void)worker;
+
+  for (size_t slot = begin; slot < end; slot++) {
+    size_t block = job->first_block + slot;
+    unsigned int first = block * EXPORT_BLOCK_SIZE;
+    unsigned int last = first + EXPORT_BLOCK_SIZE;
+    if (last > job->model->polygon_count) last = job->model->polygon_count;
+
+    char *ptr = job->buffers[slot];
+    unsigned int index = polygon_start(job->model, first);
+    for (unsigned int i = first; i < last; i++) {
+      unsigned int size = polygon_size(job->model, i);
+      *ptr++ = 'f';
+      for (unsigned int j = 0; j < size; j++) {
+        *ptr++ = ' ';
+        ptr += format_uint(job->model->faces[index++], ptr);
+      }
+      *ptr++ = '\n';
+    }
+    job->sizes[slot] = ptr - job->buffers[slot];
+  }
+}
+
+// Formats blocks of EXPORT_BLOCK_SIZE elements in parallel, one batch of
+// blocks at a time, and writes each batch in order, so memory stays bounded
+// by the batch and never by the model.
+static int write_blocks(FILE *file, ExportJob *job, size_t total_blocks,
+                        size_t block_capacity, ParallelTask task) {
+  int error_code = OK;
+  size_t batch = parallel_worker_count();
+  char *buffers[PARALLEL_MAX_WORKERS] = {0};
+  size_t sizes[PARALLEL_MAX_WORKERS] = {0};
+
+  if (batch > total_blocks) batch = total_blocks;
+
+  for (size_t i = 0; i < batch && error_code == OK; i++) {
+    buffers[i] = memory_allocation(block_capacity, "export buffer");
+    if (buffers[i] == NULL) error_code = ERROR;
+  }
+
+  job->buffers = buffers;
+  job->sizes = sizes;
+  for (size_t first = 0; first < total_blocks && error_code == OK;
+       first += batch) {
+    job->first_block = first;
+    job->block_count =
+        total_blocks - first < batch ? total_blocks - first : batch;
+    parallel_for(job->block_count, 1, task, job);
+
+    for (size_t i = 0; i < job->block_count && error_code == OK; i++) {
+      if (fwrite(buffers[i], 1, sizes[i], file) != sizes[i]) {
+        error_code = ERROR;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < batch; i++) {
+    free(buffers[i]);
+  }
+  return error_code;
+}
+
+int export_model_obj(const char *filename, const Model1 *model,
+                     ModelError *error) {
+  int error_code = OK;
+  size_t vertex_blocks =
+      (model->vertex_count + EXPORT_BLOCK_SIZE - 1) / EXPORT_BLOCK_SIZE;
+  size_t face_blocks =
+      (model->polygon_count + EXPORT_BLOCK_SIZE - 1) / EXPORT_BLOCK_SIZE;
+  size_t face_block_capacity = 0;
+
+  // The largest face block in bytes: at most 10 digits and a space per
+  // corner, plus "f" and a newline per polygon.
+  for (size_t block = 0; block < face_blocks; block++) {
+    unsigned int first = block * EXPORT_BLOCK_SIZE;
+    unsigned int last = first + EXPORT_BLOCK_SIZE;
+    if (last > model->polygon_count) last = model->polygon_count;
+
+    size_t bytes =
+        (size_t)(polygon_start(model, last) - polygon_start(model, first)) *
+            11 +
+        (size_t)(last - first) * 2;
+    if (bytes > face_block_capacity) face_block_capacity = bytes;
+  }
+
+  clear_model_error(error);
+  FILE *file = fopen(filename, "wb");
+  if (file == NULL) {
+    set_model_error(error, MODEL_ERROR_OPEN, 0, "Could not create the file");
+    error_code = ERROR;
+  }
+
+  if (error_code == OK) {
+    ExportJob job = {model, 0, 0, NULL, NULL};
+    fprintf(file, "# 3DViewer export: %u vertices, %u polygons\n",
+            model->vertex_count, model->polygon_count);
+    error_code = write_blocks(
+        file, &job, vertex_blocks,
+        EXPORT_BLOCK_SIZE * (3 * (EXPORT_NUMBER_LENGTH + 1) + 2),
+        format_vertex_blocks);
+    if (error_code == OK) {
+      error_code = write_blocks(file, &job, face_blocks,
+                                face_block_capacity, format_face_blocks);
+    }
+  }
+
+  if (file && fclose(file) != 0) {
+    error_code = ERROR;
+  }
+  if (error_code != OK) {
+    set_model_error(error, MODEL_ERROR_WRITE, 0, "Could not write the file");
+  }
+
+  return error_code;
+}
+
+// The file keeps one corner count per polygon whatever the encoding in
+// memory, written a block at a time.
+static int write_polygon_sizes(FILE *file, const Model1 *model) {
+  int error_code = OK;
+  int sizes[EXPORT_BLOCK_SIZE];
+
+  for (unsigned int first = 0; first < model->polygon_count && error_code == OK;
+       first += EXPORT_BLOCK_SIZE) {
+    unsigned int count = model->polygon_count - first;
+    if (count > EXPORT_BLOCK_SIZE) count = EXPORT_BLOCK_SIZE;
+    for (unsigned int i = 0; i < count; i++) {
+      sizes[i] = polygon_size(model, first + i);
+    }
+    if (fwrite(sizes, sizeof(int), count, file) != count) {
+      error_code = ERROR;
+    }
+  }
+
+  return error_code;
+}
+
+int export_model_binary(const char *filename, const Model1 *model,
+                        ModelError *error) {
+  int error_code = OK;
+  FILE *file = fopen(filename, "wb");
+
+  clear_model_error(error);
+  if (file == NULL) {
+    set_model_error(error, MODEL_ERROR_OPEN, 0, "Could not create the file");
+    error_code = ERROR;
+  } else {
+    BinaryHeader header = {BINARY_MAGIC, BINARY_BYTE_ORDER, BINARY_VERSION,
+                           model->vertex_count, model->polygon_count,
+                           model->face_count};
+    setvbuf(file, NULL, _IOFBF, EXPORT_WRITE_BUFFER);
+
+    if (fwrite(&header, sizeof(header), 1, file) != 1 ||
+        fwrite(model->vertices, sizeof(double) * 3, model->vertex_count,
+               file) != model->vertex_count ||
+        write_polygon_sizes(file, model) != OK ||
+        fwrite(model->faces, sizeof(unsigned int), model->face_count, file) !=
+            model->face_count) {
+      error_code = ERROR;
+    }
+    if (fclose(file) != 0) {
+      error_code = ERROR;
+    }
+    if (error_code != OK) {
+      set_model_error(error, MODEL_ERROR_WRITE, 0, "Could not write the file");
+    }
+  }
+
+  return error_code;
+}
+
+// Counts that need more bytes than the file holds are rejected before
+// anything is allocated, so a corrupt header cannot ask for huge buffers.
+static int check_binary_size(FILE *file, const BinaryHeader *header,
+                             ModelError *error) {
+  int error_code = OK;
+  long size = -1;
+  uint64_t expected = sizeof(BinaryHeader) +
+                      (uint64_t)header->vertex_count * sizeof(double) * 3 +
+                      (uint64_t)header->polygon_count * sizeof(int) +
+                      (uint64_t)header->face_count * sizeof(unsigned int);
+
+  if (fseek(file, 0, SEEK_END) == 0) size = ftell(file);
+  if (size < 0 || (uint64_t)size < expected ||
+      fseek(file, sizeof(BinaryHeader), SEEK_SET) != 0) {
+    set_model_error(error, MODEL_ERROR_TRUNCATED, 0,
+                    "Binary model header does not match the file size");
+    error_code = ERROR;
+  }
+
+  return error_code;
+}
+
+// Every corner count must be positive and the counts must add up to the
+// face count, and every corner must name a vertex of the file, as in OBJ.
+static int check_binary_polygons(const Model1 *model,
+                                 const BinaryHeader *header,
+                                 ModelError *error) {
+  int error_code = OK;
+  const int *sizes = (const int *)model->polygon_offsets;
+  uint64_t corners = 0;
+
+  for (unsigned int p = 0; p < header->polygon_count && error_code == OK;
+       p++) {
+    if (sizes[p] <= 0) {
+      set_model_error(error, MODEL_ERROR_FORMAT, 0,
+                      "Polygon %u has %d corners", p, sizes[p]);
+      error_code = ERROR;
+    }
+    corners += (unsigned int)sizes[p];
+  }
+  if (error_code == OK && corners != header->face_count) {
+    set_model_error(error, MODEL_ERROR_FORMAT, 0,
+                    "Polygon sizes do not add up to the face count");
+    error_code = ERROR;
+  }
+  for (unsigned int i = 0; i < header->face_count && error_code == OK; i++) {
+    if (model->faces[i] == 0 || model->faces[i] > header->vertex_count) {
+      set_model_error(error, MODEL_ERROR_INDEX, 0,
+                      "Invalid index %u in binary face corner %u",
+                      model->faces[i], i);
+      error_code = ERROR;
+    }
+  }
+
+  return error_code;
+}
+
+int load_binary_model(const char *filename, Model1 *model, ModelError *error) {
+  int error_code = OK;
+  BinaryHeader header = {{0}, 0, 0, 0, 0, 0};
+  FILE *file = fopen(filename, "rb");
+
+  if (file == NULL) {
+    set_model_error(error, MODEL_ERROR_OPEN, 0, "Could not open the file");
+    error_code = ERROR;
+  } else if (fread(&header, sizeof(header), 1, file) != 1 ||
+             header.byte_order != BINARY_BYTE_ORDER ||
+             header.version != BINARY_VERSION) {
+    set_model_error(error, MODEL_ERROR_FORMAT, 0,
+                    "Unsupported binary model version or byte order");
+    error_code = ERROR;
+  } else {
+    error_code = check_binary_size(file, &header, error);
+  }
+
+  size_t offset_bytes =
+      ((size_t)header.polygon_count + 1) * sizeof(unsigned int);
+  size_t model_bytes = sizeof(double) * 3 * header.vertex_count +
+                       offset_bytes +
+                       sizeof(unsigned int) * header.face_count;
+  if (error_code == OK) {
+    error_code =
+        check_memory_budget("Model", model_bytes, header.vertex_count,
+                            header.face_count, &model->float_vertices, error);
+  }
+
+  if (error_code == OK) {
+    model->vertices = parser_allocation(
+        sizeof(double) * 3 * header.vertex_count, "model.vertices", error);
+    model->polygon_offsets =
+        parser_allocation(offset_bytes, "model.polygon_offsets", error);
+    model->faces = parser_allocation(sizeof(unsigned int) * header.face_count,
+                                     "model.faces", error);
+    if ((!model->vertices && header.vertex_count) ||
+        !model->polygon_offsets ||
+        (!model->faces && header.face_count)) {
+      error_code = ERROR;
+    } else {
+      update_model_memory(model, model_bytes);
+    }
+  }
+
+  if (error_code == OK &&
+      (fread(model->vertices, sizeof(double) * 3, header.vertex_count, file) !=
+           header.vertex_count ||
+       fread(model->polygon_offsets, sizeof(int), header.polygon_count,
+             file) != header.polygon_count ||
+       fread(model->faces, sizeof(unsigned int), header.face_count, file) !=
+           header.face_count)) {
+    set_model_error(error, MODEL_ERROR_TRUNCATED, 0, "Truncated binary model");
+    error_code = ERROR;
+  }
+
+  if (error_code == OK) {
+    error_code = check_binary_polygons(model, &header, error);
+  }
+
+  // Corner counts become offsets in place; the scan stores the total corner
+  // count in the extra last entry.
+  if (error_code == OK) {
+    error_code = parallel_exclusive_scan(model->polygon_offsets,
+                                         header.polygon_count);
+  }
+
+  if (error_code == OK) {
+    model->vertex_count = header.vertex_count;
+    model->polygon_count = header.polygon_count;
+    model->face_count = header.face_count;
+    compact_polygons(model);
+    if (model->polygon_offsets == NULL) {
+      update_model_memory(model, model_bytes - offset_bytes);
+    }
+    init_bounds(model);
+    for (unsigned int i = 0; i < model->vertex_count * 3; i += 3) {
+      update_bounds(model, model->vertices + i);
+    }
+  }
+
+  if (file) {
+    fclose(file);
+  }
+  return error_code;
+}
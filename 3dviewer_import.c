@@ -0,0 +1,660 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "3dviewer.h"
+
+typedef struct mapped_file {
+  const unsigned char *data;
+  size_t size;
+} MappedFile;
+
+typedef enum {
+  PLY_CHAR,
+  PLY_UCHAR,
+  PLY_SHORT,
+  PLY_USHORT,
+  PLY_INT,
+  PLY_UINT,
+  PLY_FLOAT,
+  PLY_DOUBLE,
+  PLY_TYPE_COUNT
+} PlyType;
+
+typedef struct ply_property {
+  char name[PLY_NAME_LENGTH];
+  PlyType type;
+  int is_list;
+  PlyType count_type;
+} PlyProperty;
+
+typedef struct ply_element {
+  char name[PLY_NAME_LENGTH];
+  unsigned int count;
+  unsigned int property_count;
+  PlyProperty properties[PLY_MAX_PROPERTIES];
+} PlyElement;
+
+typedef struct ply_header {
+  int big_endian;
+  unsigned int element_count;
+  PlyElement elements[PLY_MAX_ELEMENTS];
+  size_t data_offset;
+} PlyHeader;
+
+typedef struct ply_vertex_job {
+  const unsigned char *data;
+  size_t stride;
+  size_t offsets[3];
+  PlyType types[3];
+  int big_endian;
+  double *vertices;
+} PlyVertexJob;
+
+static const char *ply_type_names[PLY_TYPE_COUNT][2] = {
+    {"char", "int8"},   {"uchar", "uint8"},   {"short", "int16"},
+    {"ushort", "uint16"}, {"int", "int32"},   {"uint", "uint32"},
+    {"float", "float32"}, {"double", "float64"}};
+static const unsigned int ply_type_sizes[PLY_TYPE_COUNT] = {1, 1, 2, 2,
+                                                            4, 4, 4, 8};
+
+// The mapping outlives the descriptor and is read in place: no read()
+// copies and no buffer for the whole file.
+static int map_file(const char *filename, MappedFile *mapped,
+                    ModelError *error) {
+  int error_code = OK;
+  struct stat info;
+  int fd = open(filename, O_RDONLY);
+
+  mapped->data = NULL;
+  mapped->size = 0;
+  if (fd < 0 || fstat(fd, &info) != 0) {
+    set_model_error(error, MODEL_ERROR_OPEN, 0, "Could not open the file");
+    error_code = ERROR;
+  } else if (info.st_size > 0) {
+    void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      set_model_error(error, MODEL_ERROR_OPEN, 0, "Could not map the file");
+      error_code = ERROR;
+    } else {
+      posix_madvise(data, info.st_size, POSIX_MADV_SEQUENTIAL);
+      mapped->data = data;
+      mapped->size = info.st_size;
+    }
+  }
+
+  if (fd >= 0) close(fd);
+  return error_code;
+}
+
+static void unmap_file(MappedFile *mapped) {
+  if (mapped->data) munmap((void *)mapped->data, mapped->size);
+  mapped->data = NULL;
+  mapped->size = 0;
+}
+
+static uint64_t read_bytes(const unsigned char *ptr, unsigned int size,
+                           int big_endian) {
+  uint64_t value = 0;
+  for (unsigned int i = 0; i < size; i++) {
+    unsigned int shift = 8 * (big_endian ? size - 1 - i : i);
+    value |= (uint64_t)ptr[i] << shift;
+  }
+  return value;
+}
+
+static float read_float(const unsigned char *ptr, int big_endian) {
+  uint32_t bits = (uint32_t)read_bytes(ptr, 4, big_endian);
+  float value = 0;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+static double read_ply_value(const unsigned char *ptr, PlyType type,
+                             int big_endian) {
+  uint64_t bits = read_bytes(ptr, ply_type_sizes[type], big_endian);
+  double value = 0;
+
+  switch (type) {
+    case PLY_CHAR:
+      value = (int8_t)bits;
+      break;
+    case PLY_SHORT:
+      value = (int16_t)bits;
+      break;
+    case PLY_INT:
+      value = (int32_t)bits;
+      break;
+    case PLY_FLOAT:
+      value = read_float(ptr, big_endian);
+      break;
+    case PLY_DOUBLE:
+      memcpy(&value, &bits, sizeof(value));
+      break;
+    default:
+      value = (double)bits;
+      break;
+  }
+  return value;
+}
+
+static int has_extension(const char *filename, const char *extension) {
+  size_t length = strlen(filename);
+  size_t extension_length = strlen(extension);
+  int result = length >= extension_length;
+
+  for (size_t i = 0; result && i < extension_length; i++) {
+    result = tolower((unsigned char)filename[length - extension_length + i]) ==
+             extension[i];
+  }
+  return result;
+}
+
+// Magic bytes win over the extension: a binary STL is recognized by its
+// size matching the triangle count in its header, whatever it is called.
+ModelFormat detect_model_format(const char *filename) {
+  ModelFormat format = FORMAT_OBJ;
+  unsigned char header[STL_HEADER_SIZE + 4] = {0};
+  size_t read = 0;
+  long size = -1;
+  FILE *file = fopen(filename, "rb");
+
+  if (file != NULL) {
+    read = fread(header, 1, sizeof(header), file);
+    if (fseek(file, 0, SEEK_END) == 0) size = ftell(file);
+    fclose(file);
+  }
+
+  uint64_t stl_size =
+      STL_HEADER_SIZE + 4 +
+      (uint64_t)STL_TRIANGLE_SIZE * read_bytes(header + STL_HEADER_SIZE, 4, 0);
+  if (read >= 4 && memcmp(header, BINARY_MAGIC, 4) == 0) {
+    format = FORMAT_BINARY;
+  } else if (read >= 4 && memcmp(header, "ply", 3) == 0 &&
+             (header[3] == '\n' || header[3] == '\r')) {
+    format = FORMAT_PLY;
+  } else if ((read == sizeof(header) && (uint64_t)size == stl_size) ||
+             has_extension(filename, ".stl")) {
+    format = FORMAT_STL;
+  } else if (has_extension(filename, ".ply")) {
+    format = FORMAT_PLY;
+  }
+
+  return format;
+}
+
+static int find_ply_type(const char *name, PlyType *type) {
+  int error_code = ERROR;
+  for (int i = 0; i < PLY_TYPE_COUNT && error_code != OK; i++) {
+    if (strcmp(name, ply_type_names[i][0]) == 0 ||
+        strcmp(name, ply_type_names[i][1]) == 0) {
+      *type = (PlyType)i;
+      error_code = OK;
+    }
+  }
+  return error_code;
+}
+
+static int parse_ply_header_line(const char *line, PlyHeader *header,
+                                 int *binary) {
+  int error_code = OK;
+  char word[3][PLY_NAME_LENGTH] = {{0}};
+  unsigned int count = 0;
+  PlyElement *element =
+      header->element_count ? &header->elements[header->element_count - 1]
+                            : NULL;
+
+  if (sscanf(line, "format %31s", word[0]) == 1) {
+    *binary = strcmp(word[0], "ascii") != 0;
+    header->big_endian = strcmp(word[0], "binary_big_endian") == 0;
+  } else if (sscanf(line, "element %31s %u", word[0], &count) == 2) {
+    if (header->element_count == PLY_MAX_ELEMENTS) {
+      error_code = ERROR;
+    } else {
+      element = &header->elements[header->element_count++];
+      memset(element, 0, sizeof(PlyElement));
+      strcpy(element->name, word[0]);
+      element->count = count;
+    }
+  } else if (strncmp(line, "property", 8) == 0) {
+    PlyProperty property = {{0}, PLY_CHAR, 0, PLY_CHAR};
+    if (element == NULL || element->property_count == PLY_MAX_PROPERTIES) {
+      error_code = ERROR;
+    } else if (sscanf(line, "property list %31s %31s %31s", word[0], word[1],
+                      word[2]) == 3) {
+      property.is_list = 1;
+      strcpy(property.name, word[2]);
+      error_code = find_ply_type(word[0], &property.count_type);
+      if (error_code == OK) error_code = find_ply_type(word[1], &property.type);
+    } else if (sscanf(line, "property %31s %31s", word[0], word[1]) == 2) {
+      strcpy(property.name, word[1]);
+      error_code = find_ply_type(word[0], &property.type);
+    } else {
+      error_code = ERROR;
+    }
+    if (error_code == OK) {
+      element->properties[element->property_count++] = property;
+    }
+  }
+
+  return error_code;
+}
+
+static int parse_ply_header(const MappedFile *file, PlyHeader *header,
+                            ModelError *error) {
+  int error_code = OK;
+  int binary = -1;
+  int finished = 0;
+  size_t position = 0;
+  unsigned int line_number = 0;
+
+  memset(header, 0, sizeof(PlyHeader));
+  while (error_code == OK && !finished && position < file->size) {
+    char line[MAX_LINE_LENGTH];
+    size_t length = 0;
+    while (position + length < file->size &&
+           file->data[position + length] != '\n' &&
+           length < MAX_LINE_LENGTH - 1) {
+      line[length] = file->data[position + length];
+      length++;
+    }
+    position += length + 1;
+    line_number++;
+    if (length > 0 && line[length - 1] == '\r') length--;
+    line[length] = '\0';
+
+    if (strcmp(line, "end_header") == 0) {
+      finished = 1;
+    } else {
+      error_code = parse_ply_header_line(line, header, &binary);
+    }
+  }
+
+  if (error_code != OK) {
+    set_model_error(error, MODEL_ERROR_SYNTAX, line_number,
+                    "Invalid PLY header line");
+  } else if (!finished) {
+    set_model_error(error, MODEL_ERROR_TRUNCATED, line_number,
+                    "PLY header has no end_header");
+    error_code = ERROR;
+  } else if (binary != 1) {
+    set_model_error(error, MODEL_ERROR_FORMAT, 0,
+                    "Only binary PLY is supported");
+    error_code = ERROR;
+  }
+  header->data_offset = position;
+  return error_code;
+}
+
+// List lengths come from the file; a negative one means a corrupt file.
+static double read_ply_count(const MappedFile *file,
+                             const PlyProperty *property, size_t position,
+                             int big_endian) {
+  double count = -1;
+  if (position + ply_type_sizes[property->count_type] <= file->size) {
+    count = read_ply_value(file->data + position, property->count_type,
+                           big_endian);
+  }
+  return count;
+}
+
+// Walks `count` records of an element from `position`; lists are measured
+// from their count field. Returns the offset just past the element, or 0
+// when the file ends first.
+static size_t skip_ply_element(const MappedFile *file,
+                               const PlyElement *element, size_t position,
+                               int big_endian) {
+  for (unsigned int i = 0; i < element->count && position != 0; i++) {
+    for (unsigned int p = 0; p < element->property_count && position != 0;
+         p++) {
+      const PlyProperty *property = &element->properties[p];
+      size_t size = ply_type_sizes[property->type];
+      if (property->is_list) {
+        double count = read_ply_count(file, property, position, big_endian);
+        if (count < 0) {
+          position = 0;
+        } else {
+          size = ply_type_sizes[property->count_type] + size * (size_t)count;
+        }
+      }
+      if (position != 0) {
+        position = position + size <= file->size ? position + size : 0;
+      }
+    }
+  }
+  return position;
+}
+
+static int find_ply_property(const PlyElement *element, const char *name,
+                             const char *alias) {
+  int found = -1;
+  for (unsigned int p = 0; p < element->property_count && found < 0; p++) {
+    if (strcmp(element->properties[p].name, name) == 0 ||
+        (alias && strcmp(element->properties[p].name, alias) == 0)) {
+      found = p;
+    }
+  }
+  return found;
+}
+
+static void convert_ply_vertices(void *context, size_t begin, size_t end,
+                                 unsigned int worker) {
+  PlyVertexJob *job = context;
+  (void)worker;
+
+  for (size_t i = begin; i < end; i++) {
+    const unsigned char *record = job->data + i * job->stride;
+    for (int axis = 0; axis < 3; axis++) {
+      job->vertices[3 * i + axis] = read_ply_value(
+          record + job->offsets[axis], job->types[axis], job->big_endian);
+    }
+  }
+}
+
+static int read_ply_vertices(const MappedFile *file, const PlyHeader *header,
+                             const PlyElement *element, size_t position,
+                             Model1 *model, ModelError *error) {
+  int error_code = OK;
+  PlyVertexJob job = {file->data + position, 0, {0}, {0}, header->big_endian,
+                      model->vertices};
+  const char *axes[3] = {"x", "y", "z"};
+
+  for (unsigned int p = 0; p < element->property_count; p++) {
+    if (element->properties[p].is_list) error_code = ERROR;
+    for (int axis = 0; axis < 3; axis++) {
+      if (strcmp(element->properties[p].name, axes[axis]) == 0) {
+        job.offsets[axis] = job.stride;
+        job.types[axis] = element->properties[p].type;
+      }
+    }
+    job.stride += ply_type_sizes[element->properties[p].type];
+  }
+  for (int axis = 0; axis < 3; axis++) {
+    if (find_ply_property(element, axes[axis], NULL) < 0) error_code = ERROR;
+  }
+
+  if (error_code != OK) {
+    set_model_error(error, MODEL_ERROR_FORMAT, 0,
+                    "Unsupported PLY vertex layout");
+  } else {
+    parallel_for(element->count, PARALLEL_GRAIN, convert_ply_vertices, &job);
+  }
+  return error_code;
+}
+
+// Faces are variable-sized records, so they are read in one sequential
+// pass; PLY indices are 0-based and become 1-based like OBJ ones.
+static int read_ply_faces(const MappedFile *file, const PlyHeader *header,
+                          const PlyElement *element, size_t position,
+                          int list, Model1 *model, ModelError *error) {
+  int error_code = OK;
+  unsigned int corner = 0;
+
+  for (unsigned int f = 0; f < element->count && error_code == OK; f++) {
+    for (unsigned int p = 0; p < element->property_count; p++) {
+      const PlyProperty *property = &element->properties[p];
+      size_t size = ply_type_sizes[property->type];
+      if (property->is_list) {
+        unsigned int count =
+            read_ply_count(file, property, position, header->big_endian);
+        position += ply_type_sizes[property->count_type];
+        if ((int)p == list) {
+          model->polygon_offsets[f] = corner;
+          for (unsigned int i = 0; i < count && error_code == OK; i++) {
+            double index = read_ply_value(file->data + position + i * size,
+                                          property->type, header->big_endian);
+            if (index < 0 || index >= model->vertex_count) {
+              set_model_error(error, MODEL_ERROR_INDEX, 0,
+                              "Invalid index %.0f in PLY face %u", index, f);
+              error_code = ERROR;
+            } else {
+              model->faces[corner++] = (unsigned int)index + 1;
+            }
+          }
+        }
+        size *= count;
+      }
+      position += size;
+    }
+  }
+  if (error_code == OK) {
+    model->polygon_offsets[element->count] = corner;
+  }
+
+  return error_code;
+}
+
+static int count_ply_corners(const MappedFile *file, const PlyHeader *header,
+                             const PlyElement *element, size_t position,
+                             int list, size_t *corners) {
+  *corners = 0;
+  for (unsigned int f = 0; f < element->count; f++) {
+    for (unsigned int p = 0; p < element->property_count; p++) {
+      const PlyProperty *property = &element->properties[p];
+      size_t size = ply_type_sizes[property->type];
+      if (property->is_list) {
+        size_t count =
+            read_ply_count(file, property, position, header->big_endian);
+        position += ply_type_sizes[property->count_type];
+        if ((int)p == list) *corners += count;
+        size *= count;
+      }
+      position += size;
+    }
+  }
+  return *corners <= UINT_MAX ? OK : ERROR;
+}
+
+int load_ply_model(const char *filename, Model1 *model, ModelError *error) {
+  int error_code = OK;
+  MappedFile file = {NULL, 0};
+  PlyHeader header = {0};
+  const PlyElement *vertices = NULL;
+  const PlyElement *faces = NULL;
+  size_t vertex_position = 0;
+  size_t face_position = 0;
+  size_t position = 0;
+  size_t corners = 0;
+  int list = -1;
+
+  error_code = map_file(filename, &file, error);
+  if (error_code == OK) error_code = parse_ply_header(&file, &header, error);
+
+  // Every element is walked once to find where vertices and faces start and
+  // to make sure the file holds all the records its header promises.
+  position = header.data_offset;
+  for (unsigned int e = 0; e < header.element_count && error_code == OK; e++) {
+    const PlyElement *element = &header.elements[e];
+    if (strcmp(element->name, "vertex") == 0) {
+      vertices = element;
+      vertex_position = position;
+    } else if (strcmp(element->name, "face") == 0) {
+      faces = element;
+      face_position = position;
+      list = find_ply_property(element, "vertex_indices", "vertex_index");
+    }
+    position = skip_ply_element(&file, element, position, header.big_endian);
+    if (position == 0) {
+      set_model_error(error, MODEL_ERROR_TRUNCATED, 0,
+                      "PLY file ends inside element '%s'", element->name);
+      error_code = ERROR;
+    }
+  }
+  if (error_code == OK && vertices == NULL) {
+    set_model_error(error, MODEL_ERROR_FORMAT, 0, "PLY file has no vertices");
+    error_code = ERROR;
+  }
+  if (error_code == OK && faces != NULL && list < 0) {
+    set_model_error(error, MODEL_ERROR_FORMAT, 0,
+                    "PLY faces have no vertex_indices");
+    error_code = ERROR;
+  }
+  if (error_code == OK && faces != NULL) {
+    error_code = count_ply_corners(&file, &header, faces, face_position, list,
+                                   &corners);
+    if (error_code != OK) {
+      set_model_error(error, MODEL_ERROR_FORMAT, 0,
+                      "Too many PLY face corners");
+    }
+  }
+
+  unsigned int polygon_count = faces && list >= 0 ? faces->count : 0;
+  size_t model_bytes = sizeof(double) * 3 * (vertices ? vertices->count : 0) +
+                       sizeof(unsigned int) * (polygon_count + 1) +
+                       sizeof(unsigned int) * corners;
+  if (error_code == OK) {
+    error_code = check_memory_budget("Model", model_bytes, vertices->count,
+                                     corners, &model->float_vertices, error);
+  }
+
+  if (error_code == OK) {
+    model->vertices = parser_allocation(
+        sizeof(double) * 3 * vertices->count + 1, "model.vertices", error);
+    model->polygon_offsets =
+        parser_allocation(sizeof(unsigned int) * (polygon_count + 1),
+                          "model.polygon_offsets", error);
+    model->faces = parser_allocation(sizeof(unsigned int) * corners + 1,
+                                     "model.faces", error);
+    if (!model->vertices || !model->polygon_offsets || !model->faces) {
+      error_code = ERROR;
+    } else {
+      update_model_memory(model, model_bytes);
+      model->vertex_count = vertices->count;
+      model->polygon_count = polygon_count;
+      model->face_count = corners;
+    }
+  }
+
+  if (error_code == OK) {
+    error_code =
+        read_ply_vertices(&file, &header, vertices, vertex_position, model,
+                          error);
+  }
+  if (error_code == OK && polygon_count > 0) {
+    error_code =
+        read_ply_faces(&file, &header, faces, face_position, list, model,
+                       error);
+  }
+  if (error_code == OK) {
+    compact_polygons(model);
+    if (model->polygon_offsets == NULL) {
+      update_model_memory(model, model_bytes - sizeof(unsigned int) *
+                                                   (polygon_count + 1));
+    }
+  }
+
+  if (error_code == OK) {
+    init_bounds(model);
+    for (unsigned int i = 0; i < model->vertex_count * 3; i += 3) {
+      update_bounds(model, model->vertices + i);
+    }
+  }
+
+  unmap_file(&file);
+  return error_code;
+}
+
+static uint32_t hash_stl_vertex(const unsigned char *ptr) {
+  uint32_t hash = 0;
+  for (int axis = 0; axis < 3; axis++) {
+    uint32_t bits = (uint32_t)read_bytes(ptr + 4 * axis, 4, 0);
+    if ((bits & 0x7fffffffu) == 0) bits = 0;  // -0 and 0 are one vertex
+    hash = (hash ^ bits) * 0x9e3779b1u;
+    hash ^= hash >> 15;
+  }
+  return hash;
+}
+
+// Binary STL repeats every corner in every triangle; corners with equal
+// coordinates are merged through an open-addressing table of vertex ids,
+// in file order so the result does not depend on the table size.
+int load_stl_model(const char *filename, Model1 *model, ModelError *error) {
+  int error_code = OK;
+  MappedFile file = {NULL, 0};
+  unsigned int *table = NULL;
+  size_t triangles = 0;
+  size_t table_size = 16;
+
+  error_code = map_file(filename, &file, error);
+  if (error_code == OK && file.size < STL_HEADER_SIZE + 4) {
+    set_model_error(error, MODEL_ERROR_TRUNCATED, 0, "Truncated STL file");
+    error_code = ERROR;
+  }
+  if (error_code == OK) {
+    triangles = read_bytes(file.data + STL_HEADER_SIZE, 4, 0);
+    if (file.size < STL_HEADER_SIZE + 4 + triangles * STL_TRIANGLE_SIZE) {
+      set_model_error(error, MODEL_ERROR_TRUNCATED, 0, "%s STL file",
+                      memcmp(file.data, "solid", 5) == 0 ? "Truncated or ASCII"
+                                                         : "Truncated");
+      error_code = ERROR;
+    }
+  }
+
+  while (table_size < triangles * 6) table_size <<= 1;
+  size_t corners = triangles * 3;
+  size_t model_bytes =
+      sizeof(double) * 3 * corners + sizeof(unsigned int) * corners;
+  if (error_code == OK) {
+    error_code = check_memory_budget(
+        "Model", model_bytes + sizeof(unsigned int) * table_size, corners,
+        corners, &model->float_vertices, error);
+  }
+
+  if (error_code == OK) {
+    model->vertices = parser_allocation(sizeof(double) * 3 * corners + 1,
+                                        "model.vertices", error);
+    model->faces = parser_allocation(sizeof(unsigned int) * corners + 1,
+                                     "model.faces", error);
+    table = parser_allocation(sizeof(unsigned int) * table_size, "STL table",
+                              error);
+    if (!model->vertices || !model->faces || !table) {
+      error_code = ERROR;
+    }
+  }
+
+  if (error_code == OK) {
+    memset(table, 0xff, sizeof(unsigned int) * table_size);
+    model->polygon_count = triangles;
+    model->polygon_arity = 3;
+    model->face_count = corners;
+    for (size_t c = 0; c < corners; c++) {
+      const unsigned char *ptr = file.data + STL_HEADER_SIZE + 4 +
+                                 (c / 3) * STL_TRIANGLE_SIZE + 12 +
+                                 (c % 3) * 12;
+      double vertex[3] = {read_float(ptr, 0), read_float(ptr + 4, 0),
+                          read_float(ptr + 8, 0)};
+      size_t slot = hash_stl_vertex(ptr) & (table_size - 1);
+      unsigned int id = table[slot];
+
+      while (id != UINT_MAX && !(model->vertices[3 * id] == vertex[0] &&
+                                 model->vertices[3 * id + 1] == vertex[1] &&
+                                 model->vertices[3 * id + 2] == vertex[2])) {
+        slot = (slot + 1) & (table_size - 1);
+        id = table[slot];
+      }
+      if (id == UINT_MAX) {
+        id = model->vertex_count++;
+        table[slot] = id;
+        memcpy(model->vertices + 3 * id, vertex, sizeof(vertex));
+      }
+      model->faces[c] = id + 1;
+    }
+
+    double *shrunk = realloc(model->vertices,
+                             sizeof(double) * 3 * model->vertex_count + 1);
+    if (shrunk) model->vertices = shrunk;
+    size_t unused_bytes = sizeof(double) * 3 * (corners - model->vertex_count);
+    update_model_memory(model, model_bytes - unused_bytes);
+
+    init_bounds(model);
+    for (unsigned int i = 0; i < model->vertex_count * 3; i += 3) {
+      update_bounds(model, model->vertices + i);
+    }
+  }
+
+  free(table);
+  unmap_file(&file);
+  return error_code;
+}
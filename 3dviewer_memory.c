@@ -0,0 +1,95 @@
+#include <stdatomic.h>
+
+#include "3dviewer.h"
+
+static atomic_size_t memory_usage[MEMORY_KIND_COUNT];
+static atomic_size_t memory_peak_usage;
+static atomic_size_t memory_budget;
+static atomic_int memory_policy;
+
+void memory_track(MemoryKind kind, long long delta) {
+  size_t current = 0;
+
+  if (delta >= 0) {
+    atomic_fetch_add(&memory_usage[kind], (size_t)delta);
+  } else {
+    atomic_fetch_sub(&memory_usage[kind], (size_t)(-delta));
+  }
+
+  current = memory_current();
+  size_t peak = atomic_load(&memory_peak_usage);
+  while (current > peak &&
+         !atomic_compare_exchange_weak(&memory_peak_usage, &peak, current)) {
+  }
+}
+
+size_t memory_current(void) {
+  size_t current = 0;
+  for (int i = 0; i < MEMORY_KIND_COUNT; i++) {
+    current += atomic_load(&memory_usage[i]);
+  }
+  return current;
+}
+
+size_t memory_usage_of(MemoryKind kind) {
+  return atomic_load(&memory_usage[kind]);
+}
+
+size_t memory_peak(void) { return atomic_load(&memory_peak_usage); }
+
+void memory_reset_peak(void) {
+  atomic_store(&memory_peak_usage, memory_current());
+}
+
+void set_memory_budget(size_t bytes, MemoryPolicy policy) {
+  atomic_store(&memory_budget, bytes);
+  atomic_store(&memory_policy, policy);
+}
+
+size_t get_memory_budget(void) { return atomic_load(&memory_budget); }
+
+MemoryPolicy get_memory_policy(void) { return atomic_load(&memory_policy); }
+
+int memory_budget_allows(size_t additional) {
+  size_t budget = get_memory_budget();
+  return budget == 0 || memory_current() + additional <= budget;
+}
+
+void update_model_memory(Model1 *model, size_t bytes) {
+  memory_track(MEMORY_MODEL, (long long)bytes - (long long)model->memory_bytes);
+  model->memory_bytes = bytes;
+}
+
+size_t estimate_gpu_bytes(unsigned int vertex_count, unsigned int index_count,
+                          int float_vertices) {
+  size_t vertex_size = float_vertices ? sizeof(float) : sizeof(double);
+  return vertex_size * 3 * vertex_count + sizeof(unsigned int) * index_count;
+}
+
+int check_memory_budget(const char *what, size_t model_bytes,
+                        unsigned int vertex_count, unsigned int index_count,
+                        int *float_vertices, ModelError *error) {
+  int error_code = OK;
+  size_t budget = get_memory_budget();
+  *float_vertices = 0;
+
+  if (!memory_budget_allows(model_bytes +
+                            estimate_gpu_bytes(vertex_count, index_count, 0))) {
+    if (get_memory_policy() == MEMORY_FLOAT_FALLBACK &&
+        memory_budget_allows(model_bytes + estimate_gpu_bytes(
+                                               vertex_count, index_count, 1))) {
+      *float_vertices = 1;
+    } else {
+      set_model_error(
+          error, MODEL_ERROR_BUDGET, 0,
+          "%s needs %.1f MB, memory budget is %.1f MB", what,
+          (double)(model_bytes +
+                   estimate_gpu_bytes(vertex_count, index_count, 1)) /
+              MEGABYTE,
+          (double)budget / MEGABYTE);
+      error_code = ERROR;
+    }
+  }
+
+  return error_code;
+}
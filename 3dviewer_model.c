@@ -1,5 +1,11 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdarg.h>
+
 #include "3dviewer.h"
 
+static locale_t numeric_locale;
+static pthread_once_t numeric_locale_once = PTHREAD_ONCE_INIT;
+
 void read_line(FILE *file, char **line) {
   if (fgets(*line, MAX_LINE_LENGTH, file) != NULL) {
     size_t line_length = strlen(*line);
@@ -11,16 +17,52 @@ void read_line(FILE *file, char **line) {
   }
 }
 
-void *memory_allocation(size_t size, const char *error_msg) {
+// Callers report a failed allocation through their own error; what only
+// names the buffer for a caller that passes a ModelError.
+void *memory_allocation(size_t size, const char *what) {
+  return parser_allocation(size, what, NULL);
+}
+
+void *parser_allocation(size_t size, const char *what, ModelError *error) {
   void *ptr = malloc(size);
 
-  if (ptr == NULL) {
-    fprintf(stderr, "Ошибка выделения памяти: %s\n", error_msg);
+  if (ptr == NULL && size > 0) {
+    set_model_error(error, MODEL_ERROR_MEMORY, 0, "Out of memory: %s", what);
   }
 
   return ptr;
 }
 
+// error may be NULL when the caller does not want the details.
+void clear_model_error(ModelError *error) {
+  if (error != NULL) memset(error, 0, sizeof(ModelError));
+}
+
+// The first error wins: later ones are usually consequences of it.
+void set_model_error(ModelError *error, ModelErrorCode code, unsigned int line,
+                     const char *format, ...) {
+  if (error != NULL && error->code == MODEL_ERROR_NONE) {
+    va_list args;
+    va_start(args, format);
+    error->code = code;
+    error->line = line;
+    vsnprintf(error->message, sizeof(error->message), format, args);
+    va_end(args);
+  }
+}
+
+int format_model_error(const ModelError *error, char *buffer, size_t size) {
+  int length = 0;
+
+  if (error->line > 0) {
+    length = snprintf(buffer, size, "line %u: %s", error->line, error->message);
+  } else {
+    length = snprintf(buffer, size, "%s", error->message);
+  }
+
+  return length;
+}
+
 double convert_to_radian(double angle) { return PI / 180 * angle; }
 
 Matrix create_identity_matrix() {
@@ -124,56 +166,148 @@ void modify_model(Model1 *model, Matrix matrix) {
     model->vertices[i + 1] = result[1];
     model->vertices[i + 2] = result[2];
   }
+
+  // Every transformation here is a rotation, a uniform scale or a
+  // translation, so normals follow the linear part and are renormalized.
+  for (unsigned int i = 0; i < model->normal_count * 3; i += 3) {
+    double normal[3] = {0};
+    for (int row = 0; row < 3; row++) {
+      normal[row] = matrix.data[row][0] * model->normals[i] +
+                    matrix.data[row][1] * model->normals[i + 1] +
+                    matrix.data[row][2] * model->normals[i + 2];
+    }
+    double length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] +
+                         normal[2] * normal[2]);
+    if (length > 0) {
+      model->normals[i] = normal[0] / length;
+      model->normals[i + 1] = normal[1] / length;
+      model->normals[i + 2] = normal[2] / length;
+    }
+  }
 }
 
-void translate_to_origin(Model1 *model) {
+Matrix translate_to_origin(Model1 *model) {
   double centerX = (model->minMaxX[0] + model->minMaxX[1]) / 2;
   double centerY = (model->minMaxY[0] + model->minMaxY[1]) / 2;
   double centerZ = (model->minMaxZ[0] + model->minMaxZ[1]) / 2;
 
   Matrix matrix = create_translation_matrix(-centerX, -centerY, -centerZ);
   modify_model(model, matrix);
+  return matrix;
 }
 
-void scale1(Model1 *model) {
+Matrix scale1(Model1 *model) {
   double x = model->minMaxX[1] - model->minMaxX[0];
   double y = model->minMaxY[1] - model->minMaxY[0];
   double z = model->minMaxZ[1] - model->minMaxZ[0];
 
   double max = y;
-  if (x > max) {
-    max = x;
-  } else if (z > max) {
-    max = z;
-  }
+  if (x > max) max = x;
+  if (z > max) max = z;
 
   double scale_value = 0.5;
   double scale = (scale_value - (scale_value * (-1))) / max;
 
   Matrix matrix = create_scale_matrix(scale);
   modify_model(model, matrix);
+  return matrix;
 }
 
-int load_model(const char *filename, Model1 *model) {
+Matrix mult_matrices(Matrix left, Matrix right) {
+  Matrix matrix;
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 4; j++) {
+      double sum = 0;
+      for (int k = 0; k < 4; k++) {
+        sum += left.data[i][k] * right.data[k][j];
+      }
+      matrix.data[i][j] = sum;
+    }
+  }
+  return matrix;
+}
+
+// Uniform scale factor of a rotation/scale/translation matrix: the cube root
+// of the determinant of its linear part.
+double transform_scale(Matrix matrix) {
+  const double(*m)[4] = matrix.data;
+  double determinant = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+                       m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+                       m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+  return cbrt(fabs(determinant));
+}
+
+void matrix_to_float(Matrix matrix, float result[16]) {
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 4; j++) {
+      result[i * 4 + j] = (float)matrix.data[i][j];
+    }
+  }
+}
+
+// Text is always read with the C numeric locale. uselocale only affects the
+// calling thread, unlike setlocale, so loads can run concurrently with each
+// other and with a GUI using the user's locale.
+static void create_numeric_locale(void) {
+  numeric_locale = newlocale(LC_NUMERIC_MASK, "C", (locale_t)0);
+}
+
+int load_model_with_error(const char *filename, Model1 *model,
+                          ModelError *error) {
   int error_code = OK;
-  setlocale(LC_NUMERIC, "en_US.UTF-8");
-  FILE *file = fopen(filename, "r");
+  Compression compression = detect_compression(filename);
+  locale_t previous_locale = (locale_t)0;
 
-  if (file == NULL) {
-    fprintf(stderr, "Ошибка при открытии файла: %s\n", filename);
-    error_code = ERROR;
+  memset(error, 0, sizeof(ModelError));
+  pthread_once(&numeric_locale_once, create_numeric_locale);
+  if (numeric_locale != (locale_t)0) {
+    previous_locale = uselocale(numeric_locale);
+  }
+
+  if (compression != COMPRESSION_NONE) {
+    error_code = load_compressed_model(filename, compression, model, error);
   } else {
-    error_code = get_model_data(file, model);
+    ModelFormat format = detect_model_format(filename);
+
+    if (format == FORMAT_BINARY) {
+      error_code = load_binary_model(filename, model, error);
+    } else if (format == FORMAT_PLY) {
+      error_code = load_ply_model(filename, model, error);
+    } else if (format == FORMAT_STL) {
+      error_code = load_stl_model(filename, model, error);
+    } else {
+      FILE *file = fopen(filename, "r");
+
+      if (file == NULL) {
+        set_model_error(error, MODEL_ERROR_OPEN, 0, "Could not open the file");
+        error_code = ERROR;
+      } else {
+        error_code = get_model_data(file, model, error);
+      }
+    }
   }
 
+  if (previous_locale != (locale_t)0) {
+    uselocale(previous_locale);
+  }
+  if (error_code != OK && error->code == MODEL_ERROR_NONE) {
+    set_model_error(error, MODEL_ERROR_FORMAT, 0, "Could not load the model");
+  }
   return error_code;
 }
 
-int get_model_data(FILE *file, Model1 *model) {
+// Kept for callers that only need the status; the details are dropped.
+int load_model(const char *filename, Model1 *model) {
+  ModelError error;
+  return load_model_with_error(filename, model, &error);
+}
+
+int get_model_data(FILE *file, Model1 *model, ModelError *error) {
   int error_code = OK;
   unsigned int vertex_count = 0;
   unsigned int face_count = 0;
   char line[MAX_LINE_LENGTH];
+  ParseContext context = {0};
 
   error_code = count_vertices_faces(line, file, &vertex_count, &face_count);
 
@@ -182,9 +316,21 @@ int get_model_data(FILE *file, Model1 *model) {
     model->polygon_count = face_count;
   }
 
+  unsigned int capability = 3 * face_count;
+  size_t model_bytes = sizeof(double) * 3 * vertex_count +
+                       sizeof(unsigned int) * (face_count + 1) +
+                       sizeof(unsigned int) * capability;
+
+  // Refuse before allocating anything when the counts from the first pass
+  // already exceed the budget.
   if (error_code == OK) {
-    model->vertices = (double *)memory_allocation(
-        sizeof(double) * 3 * vertex_count, "model.vertices");
+    error_code = check_memory_budget("Model", model_bytes, vertex_count,
+                                     capability, &model->float_vertices, error);
+  }
+
+  if (error_code == OK) {
+    model->vertices = (double *)parser_allocation(
+        sizeof(double) * 3 * vertex_count, "model.vertices", error);
 
     if (!model->vertices) {
       error_code = ERROR;
@@ -192,38 +338,89 @@ int get_model_data(FILE *file, Model1 *model) {
   }
 
   if (error_code == OK) {
-    model->num_vertices_in_polygon = (int *)memory_allocation(
-        sizeof(int) * face_count, "model.num_vertices_in_polygon");
+    model->polygon_offsets = (unsigned int *)parser_allocation(
+        sizeof(unsigned int) * (face_count + 1), "model.polygon_offsets",
+        error);
 
-    if (!model->num_vertices_in_polygon) {
+    if (!model->polygon_offsets) {
       error_code = ERROR;
     }
   }
 
-  unsigned int capability = 3 * face_count;
-
   if (error_code == OK) {
-    model->faces = (unsigned int *)memory_allocation(
-        sizeof(unsigned int) * capability, "model.faces");
+    model->faces = (unsigned int *)parser_allocation(
+        sizeof(unsigned int) * capability, "model.faces", error);
 
     if (!model->faces) {
       error_code = ERROR;
     }
   }
 
+  if (error_code == OK) {
+    update_model_memory(model, model_bytes);
+  }
+
+  init_bounds(model);
+
+  if (error_code == OK) {
+    fseek(file, 0, SEEK_SET);
+    context.model = model;
+    context.error = error;
+    context.face_capacity = capability;
+    error_code = parse_file(file, line, &context);
+    if (error_code == OK) compact_polygons(model);
+    update_model_memory(
+        model, sizeof(double) * 3 * vertex_count +
+                   (model->polygon_offsets
+                        ? sizeof(unsigned int) * (face_count + 1)
+                        : 0) +
+                   sizeof(unsigned int) * context.face_capacity +
+                   sizeof(float) * 3 * model->normal_count);
+  }
+
+  fclose(file);
+  return error_code;
+}
+
+void init_bounds(Model1 *model) {
   model->minMaxX[0] = DBL_MAX;
   model->minMaxX[1] = -DBL_MAX;
   model->minMaxY[0] = DBL_MAX;
   model->minMaxY[1] = -DBL_MAX;
   model->minMaxZ[0] = DBL_MAX;
   model->minMaxZ[1] = -DBL_MAX;
+}
 
-  if (error_code == OK) {
-    fseek(file, 0, SEEK_SET);
-    error_code = parse_file(file, line, &capability, model);
+void update_bounds(Model1 *model, const double *vertex) {
+  if (vertex[0] < model->minMaxX[0]) model->minMaxX[0] = vertex[0];
+  if (vertex[0] > model->minMaxX[1]) model->minMaxX[1] = vertex[0];
+  if (vertex[1] < model->minMaxY[0]) model->minMaxY[0] = vertex[1];
+  if (vertex[1] > model->minMaxY[1]) model->minMaxY[1] = vertex[1];
+  if (vertex[2] < model->minMaxZ[0]) model->minMaxZ[0] = vertex[2];
+  if (vertex[2] > model->minMaxZ[1]) model->minMaxZ[1] = vertex[2];
+}
+
+int reserve_buffer(void **buffer, unsigned int *capacity, unsigned int needed,
+                   size_t element_size, ModelError *error) {
+  int error_code = OK;
+
+  if (needed > *capacity) {
+    unsigned int new_capacity = *capacity > 0 ? *capacity : 1024;
+    while (new_capacity < needed) {
+      new_capacity = new_capacity > UINT_MAX / 2 ? needed : new_capacity * 2;
+    }
+
+    void *ptr = realloc(*buffer, element_size * new_capacity);
+    if (ptr == NULL) {
+      set_model_error(error, MODEL_ERROR_MEMORY, 0,
+                      "Memory allocation failed while growing buffer");
+      error_code = ERROR;
+    } else {
+      *buffer = ptr;
+      *capacity = new_capacity;
+    }
   }
 
-  fclose(file);
   return error_code;
 }
 
@@ -234,9 +431,10 @@ void free_model(Model1 *model) {
   if (model->faces) {
     free(model->faces);
   }
-  if (model->num_vertices_in_polygon) {
-    free(model->num_vertices_in_polygon);
-  }
+  free(model->polygon_offsets);
+  free(model->normals);
+  free(model->triangles);
+  update_model_memory(model, 0);
   memset(model, 0, sizeof(*model));
 }
 
@@ -248,8 +446,10 @@ void replace_decimal_separator(char *str) {
   }
 }
 
-int parse_vertices(char *line, unsigned int *vertex_index, Model1 *model) {
+int parse_vertices(ParseContext *context, char *line) {
   int error_code = OK;
+  Model1 *model = context->model;
+  double *vertex = model->vertices + context->vertex_index;
   double x = 0.0;
   double y = 0.0;
   double z = 0.0;
@@ -258,62 +458,104 @@ int parse_vertices(char *line, unsigned int *vertex_index, Model1 *model) {
   int parsed = sscanf(line, "v %lf %lf %lf", &x, &y, &z);
 
   if (parsed != 3) {
-    fprintf(stderr, "Parsing error\n");
+    set_model_error(context->error, MODEL_ERROR_SYNTAX, context->line,
+                    "Expected three coordinates after 'v'");
     error_code = ERROR;
   } else {
-    if (x < model->minMaxX[0]) model->minMaxX[0] = x;
-    if (x > model->minMaxX[1]) model->minMaxX[1] = x;
-    if (y < model->minMaxY[0]) model->minMaxY[0] = y;
-    if (y > model->minMaxY[1]) model->minMaxY[1] = y;
-    if (z < model->minMaxZ[0]) model->minMaxZ[0] = z;
-    if (z > model->minMaxZ[1]) model->minMaxZ[1] = z;
+    vertex[0] = x;
+    vertex[1] = y;
+    vertex[2] = z;
+    update_bounds(model, vertex);
+    context->vertex_index += 3;
+  }
 
-    model->vertices[*vertex_index] = x;
-    model->vertices[*vertex_index + 1] = y;
-    model->vertices[*vertex_index + 2] = z;
-    *vertex_index += 3;
+  return error_code;
+}
+
+int parse_normals(ParseContext *context, char *line) {
+  Model1 *model = context->model;
+  int error_code =
+      reserve_buffer((void **)&model->normals, &context->normal_capacity,
+                     context->normal_index + 3, sizeof(float), context->error);
+  float x = 0.0f;
+  float y = 0.0f;
+  float z = 0.0f;
+
+  // Normals are optional, so a malformed vn line only disqualifies them.
+  if (error_code == OK) {
+    replace_decimal_separator(line);
+    if (sscanf(line, "vn %f %f %f", &x, &y, &z) == 3) {
+      model->normals[context->normal_index] = x;
+      model->normals[context->normal_index + 1] = y;
+      model->normals[context->normal_index + 2] = z;
+      context->normal_index += 3;
+    } else {
+      model->normal_index_mismatch = 1;
+    }
   }
 
   return error_code;
 }
 
-int parse_faces(char *line, unsigned int *capability, Model1 *model,
-                unsigned int *face_index, unsigned int *polygon_index) {
+int parse_faces(ParseContext *context, char *line) {
   int error_code = OK;
+  Model1 *model = context->model;
   int vertex_num = 0;
-  unsigned int vertex_start = *face_index;
-  char *token;
-
-  token = strtok(line + 1, " \t");
+  unsigned int vertex_start = context->face_index;
+  // A stream has no first pass, so only the vertices read so far count
+  // there; OBJ indices refer to earlier vertices anyway.
+  unsigned int vertex_count = model->vertex_count > context->vertex_index / 3
+                                  ? model->vertex_count
+                                  : context->vertex_index / 3;
+  char *position = NULL;
+  char *token = strtok_r(line + 1, " \t", &position);
 
   while (token && error_code == OK) {
-    if (*capability < *face_index + 1) {
-      *capability = *face_index + 1000;
-      model->faces = (unsigned int *)realloc(
-          model->faces, sizeof(unsigned int) * (*capability));
-
-      if (model->faces == NULL) {
-        fprintf(stderr, "Memory allocation failed while processing face.\n");
+    if (context->face_capacity < context->face_index + 1) {
+      unsigned int *faces = (unsigned int *)realloc(
+          model->faces,
+          sizeof(unsigned int) * (context->face_index + 1000));
+
+      if (faces == NULL) {
+        set_model_error(context->error, MODEL_ERROR_MEMORY, context->line,
+                        "Memory allocation failed while processing face");
         error_code = ERROR;
+      } else {
+        model->faces = faces;
+        context->face_capacity = context->face_index + 1000;
       }
     }
     if (error_code == OK) {
-      sscanf(token, "%d", &vertex_num);
-      if (strlen(token) > 0 && sscanf(token, "%d", &vertex_num) == 1) {
+      if (sscanf(token, "%d", &vertex_num) == 1) {
         if (vertex_num < 0) {
-          fprintf(stderr, "Incorrect .obj file\n");
+          set_model_error(context->error, MODEL_ERROR_INDEX, context->line,
+                          "Relative vertex index %d is not supported",
+                          vertex_num);
+          error_code = ERROR;
+        } else if (vertex_num == 0 || (unsigned int)vertex_num > vertex_count) {
+          set_model_error(context->error, MODEL_ERROR_INDEX, context->line,
+                          "Vertex index %d is out of range", vertex_num);
           error_code = ERROR;
         }
-        model->faces[*face_index] = vertex_num;
-        *face_index += 1;
+        model->faces[context->face_index] = vertex_num;
+        context->face_index += 1;
+
+        // File normals can only be used per vertex when every corner
+        // refers to the normal with its own vertex index (v//n or v/t/n).
+        const char *normal = strchr(token, '/');
+        if (normal) normal = strchr(normal + 1, '/');
+        if (normal == NULL || atoi(normal + 1) != vertex_num) {
+          model->normal_index_mismatch = 1;
+        }
       }
 
-      token = strtok(NULL, " \t");
+      token = strtok_r(NULL, " \t", &position);
     }
   }
   if (error_code == OK) {
-    model->num_vertices_in_polygon[*polygon_index] = *face_index - vertex_start;
-    *polygon_index += 1;
+    model->polygon_offsets[context->polygon_index] = vertex_start;
+    model->polygon_offsets[context->polygon_index + 1] = context->face_index;
+    context->polygon_index += 1;
   }
 
   return error_code;
@@ -336,20 +578,19 @@ int count_vertices_faces(char *line, FILE *file, unsigned int *vertex_count,
   return error_code;
 }
 
-int parse_file(FILE *file, char *line, unsigned int *capability,
-               Model1 *model) {
+int parse_file(FILE *file, char *line, ParseContext *context) {
   int error_code = OK;
-  unsigned int vertex_index = 0;
-  unsigned int face_index = 0;
-  unsigned int polygon_index = 0;
+  Model1 *model = context->model;
   read_line(file, &line);
 
   while (line && error_code == OK) {
+    context->line += 1;
     if (line[0] == 'v' && line[1] == ' ') {
-      error_code = parse_vertices(line, &vertex_index, model);
+      error_code = parse_vertices(context, line);
+    } else if (line[0] == 'v' && line[1] == 'n' && line[2] == ' ') {
+      error_code = parse_normals(context, line);
     } else if (line[0] == 'f' && line[1] == ' ') {
-      error_code =
-          parse_faces(line, capability, model, &face_index, &polygon_index);
+      error_code = parse_faces(context, line);
     }
     if (error_code == OK) {
       read_line(file, &line);
@@ -357,8 +598,15 @@ int parse_file(FILE *file, char *line, unsigned int *capability,
   }
 
   if (error_code == OK) {
-    model->face_count = face_index;
+    model->face_count = context->face_index;
+    model->normal_count = context->normal_index / 3;
+    if (context->normal_capacity > context->normal_index &&
+        context->normal_index > 0) {
+      float *normals =
+          realloc(model->normals, sizeof(float) * context->normal_index);
+      if (normals) model->normals = normals;
+    }
   }
 
   return error_code;
-}
\ No newline at end of file
+}
@@ -0,0 +1,138 @@
+#define _POSIX_C_SOURCE 200809L
+#include <unistd.h>
+
+#include "3dviewer.h"
+
+typedef struct parallel_job {
+  ParallelTask task;
+  void *context;
+  size_t begin;
+  size_t end;
+  unsigned int worker;
+  pthread_t thread;
+} ParallelJob;
+
+typedef struct scan_job {
+  unsigned int *values;
+  size_t count;
+  unsigned int *chunk_sums;
+} ScanJob;
+
+unsigned int parallel_worker_count(void) {
+  long count = 0;
+  const char *env = getenv(PARALLEL_THREADS_ENV);
+
+  if (env != NULL) {
+    count = atol(env);
+  } else {
+    count = sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  if (count < 1) count = 1;
+  if (count > PARALLEL_MAX_WORKERS) count = PARALLEL_MAX_WORKERS;
+
+  return (unsigned int)count;
+}
+
+static void *parallel_run(void *arg) {
+  ParallelJob *job = arg;
+  job->task(job->context, job->begin, job->end, job->worker);
+  return NULL;
+}
+
+unsigned int parallel_for(size_t count, size_t min_chunk, ParallelTask task,
+                          void *context) {
+  ParallelJob jobs[PARALLEL_MAX_WORKERS];
+  int started[PARALLEL_MAX_WORKERS] = {0};
+  unsigned int workers = parallel_worker_count();
+
+  if (min_chunk == 0) min_chunk = 1;
+  if (count / min_chunk < workers) workers = count / min_chunk;
+  if (workers == 0) workers = 1;
+
+  size_t step = count / workers;
+  size_t rest = count % workers;
+  size_t begin = 0;
+  for (unsigned int i = 0; i < workers; i++) {
+    size_t size = step + (i < rest ? 1 : 0);
+    jobs[i] = (ParallelJob){task, context, begin, begin + size, i, 0};
+    begin += size;
+  }
+
+  // The calling thread takes the first range; a worker that cannot be
+  // started has its range run inline instead.
+  for (unsigned int i = 1; i < workers; i++) {
+    started[i] =
+        pthread_create(&jobs[i].thread, NULL, parallel_run, &jobs[i]) == 0;
+  }
+  parallel_run(&jobs[0]);
+  for (unsigned int i = 1; i < workers; i++) {
+    if (started[i]) {
+      pthread_join(jobs[i].thread, NULL);
+    } else {
+      parallel_run(&jobs[i]);
+    }
+  }
+
+  return workers;
+}
+
+static void scan_sum(void *context, size_t begin, size_t end,
+                     unsigned int worker) {
+  ScanJob *job = context;
+  (void)worker;
+
+  for (size_t chunk = begin; chunk < end; chunk++) {
+    size_t first = chunk * PARALLEL_SCAN_CHUNK;
+    size_t last = first + PARALLEL_SCAN_CHUNK;
+    if (last > job->count) last = job->count;
+
+    unsigned int sum = 0;
+    for (size_t i = first; i < last; i++) sum += job->values[i];
+    job->chunk_sums[chunk] = sum;
+  }
+}
+
+static void scan_apply(void *context, size_t begin, size_t end,
+                       unsigned int worker) {
+  ScanJob *job = context;
+  (void)worker;
+
+  for (size_t chunk = begin; chunk < end; chunk++) {
+    size_t first = chunk * PARALLEL_SCAN_CHUNK;
+    size_t last = first + PARALLEL_SCAN_CHUNK;
+    if (last > job->count) last = job->count;
+
+    unsigned int running = job->chunk_sums[chunk];
+    for (size_t i = first; i < last; i++) {
+      unsigned int value = job->values[i];
+      job->values[i] = running;
+      running += value;
+    }
+  }
+}
+
+// Exclusive prefix sum in place; values[count] receives the total.
+int parallel_exclusive_scan(unsigned int *values, size_t count) {
+  int error_code = OK;
+  size_t chunks = (count + PARALLEL_SCAN_CHUNK - 1) / PARALLEL_SCAN_CHUNK;
+  ScanJob job = {values, count, NULL};
+
+  job.chunk_sums =
+      memory_allocation(sizeof(unsigned int) * (chunks + 1), "scan chunks");
+  if (job.chunk_sums == NULL) {
+    error_code = ERROR;
+  } else {
+    parallel_for(chunks, 1, scan_sum, &job);
+    unsigned int total = 0;
+    for (size_t chunk = 0; chunk < chunks; chunk++) {
+      unsigned int sum = job.chunk_sums[chunk];
+      job.chunk_sums[chunk] = total;
+      total += sum;
+    }
+    parallel_for(chunks, 1, scan_apply, &job);
+    values[count] = total;
+  }
+
+  free(job.chunk_sums);
+  return error_code;
+}
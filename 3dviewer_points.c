@@ -0,0 +1,252 @@
+#include "3dviewer.h"
+
+typedef struct point_job {
+  const Model1 *model;
+  double origin[3];
+  double cells_per_unit;
+  unsigned int count;
+  unsigned int parts;
+  unsigned int *keys;
+  unsigned int *values;
+  unsigned int *keys_out;
+  unsigned int *values_out;
+  unsigned int shift;
+  unsigned int buckets;
+  unsigned int *histograms;
+} PointJob;
+
+static unsigned int spread_bits(unsigned int value) {
+  value &= 0x3ff;
+  value = (value | (value << 16)) & 0x030000ff;
+  value = (value | (value << 8)) & 0x0300f00f;
+  value = (value | (value << 4)) & 0x030c30c3;
+  value = (value | (value << 2)) & 0x09249249;
+  return value;
+}
+
+// Interleaves three 10-bit cell coordinates, x in the lowest bit, so that
+// the top 3 * l bits of the code name the cell on the 2^l grid.
+unsigned int morton_code(unsigned int x, unsigned int y, unsigned int z) {
+  return spread_bits(x) | (spread_bits(y) << 1) | (spread_bits(z) << 2);
+}
+
+static unsigned int grid_cell(double value, double origin,
+                              double cells_per_unit) {
+  double cell = (value - origin) * cells_per_unit;
+  unsigned int max_cell = (1u << POINT_LOD_DEPTH) - 1;
+  return cell <= 0 ? 0 : cell >= max_cell ? max_cell : (unsigned int)cell;
+}
+
+static void compute_codes(void *context, size_t begin, size_t end,
+                          unsigned int worker) {
+  PointJob *job = context;
+  const double *vertices = job->model->vertices;
+  (void)worker;
+
+  for (size_t i = begin; i < end; i++) {
+    const double *v = vertices + 3 * i;
+    job->keys[i] = morton_code(
+        grid_cell(v[0], job->origin[0], job->cells_per_unit),
+        grid_cell(v[1], job->origin[1], job->cells_per_unit),
+        grid_cell(v[2], job->origin[2], job->cells_per_unit));
+    job->values[i] = i;
+  }
+}
+
+static size_t part_begin(const PointJob *job, size_t part) {
+  return (size_t)job->count * part / job->parts;
+}
+
+static void count_digits(void *context, size_t begin, size_t end,
+                         unsigned int worker) {
+  PointJob *job = context;
+  unsigned int mask = job->buckets - 1;
+  (void)worker;
+
+  for (size_t part = begin; part < end; part++) {
+    unsigned int *histogram = job->histograms + part * job->buckets;
+    memset(histogram, 0, sizeof(unsigned int) * job->buckets);
+    for (size_t i = part_begin(job, part); i < part_begin(job, part + 1);
+         i++) {
+      histogram[(job->keys[i] >> job->shift) & mask]++;
+    }
+  }
+}
+
+static void scatter_digits(void *context, size_t begin, size_t end,
+                           unsigned int worker) {
+  PointJob *job = context;
+  unsigned int mask = job->buckets - 1;
+  (void)worker;
+
+  for (size_t part = begin; part < end; part++) {
+    unsigned int *offsets = job->histograms + part * job->buckets;
+    for (size_t i = part_begin(job, part); i < part_begin(job, part + 1);
+         i++) {
+      unsigned int slot = offsets[(job->keys[i] >> job->shift) & mask]++;
+      job->keys_out[slot] = job->keys[i];
+      job->values_out[slot] = job->values[i];
+    }
+  }
+}
+
+// One stable counting-sort pass on `bits` bits of the keys: each part counts
+// its own digits, the counts are turned into per-part offsets in digit-major
+// order, and each part scatters its range. bucket_start, when given,
+// receives the first position of every digit.
+static void radix_pass(PointJob *job, unsigned int shift, unsigned int bits,
+                       unsigned int *bucket_start) {
+  job->shift = shift;
+  job->buckets = 1u << bits;
+  parallel_for(job->parts, 1, count_digits, job);
+
+  unsigned int running = 0;
+  for (unsigned int digit = 0; digit < job->buckets; digit++) {
+    if (bucket_start) bucket_start[digit] = running;
+    for (unsigned int part = 0; part < job->parts; part++) {
+      unsigned int *cell = job->histograms + part * job->buckets + digit;
+      unsigned int size = *cell;
+      *cell = running;
+      running += size;
+    }
+  }
+
+  parallel_for(job->parts, 1, scatter_digits, job);
+
+  unsigned int *swap = job->keys;
+  job->keys = job->keys_out;
+  job->keys_out = swap;
+  swap = job->values;
+  job->values = job->values_out;
+  job->values_out = swap;
+}
+
+static unsigned int highest_bit(unsigned int value) {
+  unsigned int bit = 0;
+  while (value >>= 1) bit++;
+  return bit;
+}
+
+// In Morton order a point opens a new cell on the 2^l grid exactly when its
+// code differs from the previous one in the top 3 * l bits.
+static void compute_levels(void *context, size_t begin, size_t end,
+                           unsigned int worker) {
+  PointJob *job = context;
+  (void)worker;
+
+  for (size_t i = begin; i < end; i++) {
+    unsigned int level = 0;
+    if (i > 0) {
+      unsigned int difference = job->keys[i] ^ job->keys[i - 1];
+      level = difference == 0
+                  ? POINT_LOD_DEPTH + 1
+                  : (3 * POINT_LOD_DEPTH + 2 - highest_bit(difference)) / 3;
+    }
+    job->keys_out[i] = level;
+  }
+}
+
+int build_point_cloud(const Model1 *model, PointCloud *cloud,
+                      ModelError *error) {
+  int error_code = OK;
+  PointJob job = {0};
+  size_t count = model->vertex_count;
+  size_t order_bytes = sizeof(unsigned int) * (count + 1);
+  size_t scratch_bytes = 4 * order_bytes;
+  double extent = 0;
+
+  memset(cloud, 0, sizeof(PointCloud));
+  clear_model_error(error);
+  job.model = model;
+  job.count = model->vertex_count;
+  job.parts = parallel_worker_count();
+  job.origin[0] = model->minMaxX[0];
+  job.origin[1] = model->minMaxY[0];
+  job.origin[2] = model->minMaxZ[0];
+  extent = fmax(model->minMaxX[1] - model->minMaxX[0],
+                fmax(model->minMaxY[1] - model->minMaxY[0],
+                     model->minMaxZ[1] - model->minMaxZ[0]));
+  if (!(extent > 0)) extent = 1;
+  job.cells_per_unit = (1u << POINT_LOD_DEPTH) / extent;
+
+  if (!memory_budget_allows(order_bytes + scratch_bytes)) {
+    set_model_error(error, MODEL_ERROR_BUDGET, 0,
+                    "Point cloud needs %.1f MB, memory budget is %.1f MB",
+                    (order_bytes + scratch_bytes) / MEGABYTE,
+                    get_memory_budget() / MEGABYTE);
+    error_code = ERROR;
+  } else {
+    job.keys = memory_allocation(order_bytes, "point cloud keys");
+    job.values = memory_allocation(order_bytes, "point cloud keys");
+    job.keys_out = memory_allocation(order_bytes, "point cloud keys");
+    job.values_out = memory_allocation(order_bytes, "point cloud keys");
+    job.histograms = memory_allocation(
+        sizeof(unsigned int) * job.parts << POINT_RADIX_BITS,
+        "point cloud histograms");
+    if (!job.keys || !job.values || !job.keys_out || !job.values_out ||
+        !job.histograms) {
+      set_model_error(error, MODEL_ERROR_MEMORY, 0,
+                      "Not enough memory for the point cloud");
+      error_code = ERROR;
+    }
+  }
+
+  if (error_code == OK) {
+    memory_track(MEMORY_POINTS, scratch_bytes);
+    parallel_for(count, PARALLEL_GRAIN, compute_codes, &job);
+    for (unsigned int shift = 0; shift < 3 * POINT_LOD_DEPTH;
+         shift += POINT_RADIX_BITS) {
+      radix_pass(&job, shift, POINT_RADIX_BITS, NULL);
+    }
+
+    // Levels replace the codes, and a last stable pass groups the points
+    // by level while keeping Morton order inside every level.
+    parallel_for(count, PARALLEL_GRAIN, compute_levels, &job);
+    unsigned int *swap = job.keys;
+    job.keys = job.keys_out;
+    job.keys_out = swap;
+    unsigned int level_bits = highest_bit(POINT_LEVELS - 1) + 1;
+    unsigned int bucket_start[1u << POINT_RADIX_BITS];
+    radix_pass(&job, 0, level_bits, bucket_start);
+
+    for (unsigned int level = 0; level < POINT_LEVELS; level++) {
+      cloud->level_start[level] = bucket_start[level];
+    }
+    cloud->level_start[POINT_LEVELS] = model->vertex_count;
+    cloud->point_count = model->vertex_count;
+    cloud->root_size = extent;
+    cloud->order = job.values;
+    job.values = NULL;
+    cloud->memory_bytes = order_bytes;
+    memory_track(MEMORY_POINTS, (long long)order_bytes - scratch_bytes);
+  }
+
+  free(job.keys);
+  free(job.values);
+  free(job.keys_out);
+  free(job.values_out);
+  free(job.histograms);
+  return error_code;
+}
+
+void free_point_cloud(PointCloud *cloud) {
+  memory_track(MEMORY_POINTS, -(long long)cloud->memory_bytes);
+  free(cloud->order);
+  memset(cloud, 0, sizeof(PointCloud));
+}
+
+// The deepest level whose cells still cover POINT_SPACING_PIXELS pixels,
+// given the pixel size in model units, and whose prefix fits max_points.
+unsigned int point_cloud_draw_count(const PointCloud *cloud, double pixel_size,
+                                    unsigned int max_points) {
+  unsigned int level = 0;
+
+  while (level + 1 < POINT_LEVELS &&
+         cloud->root_size / (1u << (level + 1)) >=
+             pixel_size * POINT_SPACING_PIXELS &&
+         cloud->level_start[level + 2] <= max_points) {
+    level++;
+  }
+
+  return cloud->point_count == 0 ? 0 : cloud->level_start[level + 1];
+}
@@ -0,0 +1,131 @@
+#include "3dviewer.h"
+
+typedef struct polygon_job {
+  const Model1 *model;
+  unsigned int arity;
+  unsigned int *indices;
+  int mixed[PARALLEL_MAX_WORKERS];
+} PolygonJob;
+
+unsigned int polygon_start(const Model1 *model, unsigned int polygon) {
+  return model->polygon_offsets ? model->polygon_offsets[polygon]
+                                : polygon * model->polygon_arity;
+}
+
+unsigned int polygon_size(const Model1 *model, unsigned int polygon) {
+  return model->polygon_offsets ? model->polygon_offsets[polygon + 1] -
+                                      model->polygon_offsets[polygon]
+                                : model->polygon_arity;
+}
+
+static void check_arity(void *context, size_t begin, size_t end,
+                        unsigned int worker) {
+  PolygonJob *job = context;
+  const unsigned int *offsets = job->model->polygon_offsets;
+
+  for (size_t p = begin; p < end && !job->mixed[worker]; p++) {
+    job->mixed[worker] = offsets[p + 1] - offsets[p] != job->arity;
+  }
+}
+
+// Loaders fill polygon_offsets; when every polygon turns out to have the
+// same number of corners the offsets are freed and only the arity is kept.
+// The caller accounts for the freed memory.
+void compact_polygons(Model1 *model) {
+  PolygonJob job = {model, 0, NULL, {0}};
+  int mixed = 0;
+
+  if (model->polygon_offsets != NULL) {
+    if (model->polygon_count > 0) {
+      job.arity = model->polygon_offsets[1] - model->polygon_offsets[0];
+      parallel_for(model->polygon_count, PARALLEL_GRAIN, check_arity, &job);
+      for (int i = 0; i < PARALLEL_MAX_WORKERS; i++) mixed |= job.mixed[i];
+    }
+
+    if (model->polygon_count == 0 || (!mixed && job.arity > 0)) {
+      model->polygon_arity = job.arity;
+      free(model->polygon_offsets);
+      model->polygon_offsets = NULL;
+    } else {
+      model->polygon_arity = 0;
+    }
+  }
+}
+
+static void emit_line_loops(void *context, size_t begin, size_t end,
+                            unsigned int worker) {
+  PolygonJob *job = context;
+  const Model1 *model = job->model;
+  (void)worker;
+
+  for (size_t p = begin; p < end; p++) {
+    unsigned int first = polygon_start(model, p);
+    unsigned int last = first + polygon_size(model, p);
+    unsigned int *index = job->indices + first + p;
+
+    for (unsigned int i = first; i < last; i++) {
+      *index++ = model->faces[i] - 1;
+    }
+    *index = LINE_LOOP_RESTART;
+  }
+}
+
+unsigned int line_loop_count(const Model1 *model) {
+  return model->face_count + model->polygon_count;
+}
+
+// Every polygon's corners, 0-based, followed by LINE_LOOP_RESTART, so that
+// one GL_LINE_LOOP draw with primitive restart outlines all polygons.
+// Polygon p starts at polygon_start + p, so polygons are written in
+// parallel without a prefix pass.
+void build_line_loops(const Model1 *model, unsigned int *indices) {
+  PolygonJob job = {model, 0, indices, {0}};
+  parallel_for(model->polygon_count, PARALLEL_GRAIN, emit_line_loops, &job);
+}
+
+// The polygon holding corner face: with offsets, the last polygon that
+// starts at or before it, which skips empty polygons.
+unsigned int polygon_of_face(const Model1 *model, unsigned int face) {
+  unsigned int polygon = 0;
+
+  if (model->polygon_offsets == NULL) {
+    polygon = model->polygon_arity > 0 ? face / model->polygon_arity : 0;
+  } else {
+    unsigned int low = 0;
+    unsigned int high = model->polygon_count;
+    while (high - low > 1) {
+      unsigned int middle = low + (high - low) / 2;
+      if (model->polygon_offsets[middle] <= face)
+        low = middle;
+      else
+        high = middle;
+    }
+    polygon = low;
+  }
+
+  return polygon;
+}
+
+// Every polygon before a corner ends in one restart marker, so corner face
+// sits at face + polygon_of_face in the line loops.
+unsigned int line_loop_position(const Model1 *model, unsigned int face) {
+  return face + polygon_of_face(model, face);
+}
+
+// Rewrites the line loops of corners [first, last) into indices, which
+// starts at line_loop_position(first); with the same polygon layout the
+// markers in between stay where they were.
+void build_line_loop_span(const Model1 *model, unsigned int first,
+                          unsigned int last, unsigned int *indices) {
+  unsigned int polygon = polygon_of_face(model, first);
+  unsigned int start = first + polygon;
+
+  for (unsigned int face = first; face < last; face++) {
+    indices[face + polygon - start] = model->faces[face] - 1;
+    while (face + 1 < last && polygon + 1 < model->polygon_count &&
+           polygon_start(model, polygon + 1) == face + 1) {
+      indices[face + 1 + polygon - start] = LINE_LOOP_RESTART;
+      polygon++;
+    }
+  }
+}
@@ -0,0 +1,131 @@
+#include "3dviewer.h"
+
+static void add_range(RangeList *ranges, unsigned int first,
+                      unsigned int length) {
+  unsigned int last = ranges->count - 1;
+
+  if (ranges->count > 0 &&
+      (first <= ranges->first[last] + ranges->length[last] + DIFF_MERGE_GAP ||
+       ranges->count == DIFF_MAX_RANGES)) {
+    ranges->length[last] = first + length - ranges->first[last];
+  } else {
+    ranges->first[ranges->count] = first;
+    ranges->length[ranges->count] = length;
+    ranges->count++;
+  }
+}
+
+// Whole blocks are compared with memcmp first, so unchanged data costs one
+// pass at memory speed and only differing blocks are scanned per element.
+void diff_ranges(const void *old_data, const void *new_data,
+                 unsigned int count, size_t element_size, RangeList *ranges) {
+  const char *old_bytes = old_data;
+  const char *new_bytes = new_data;
+  ranges->count = 0;
+
+  for (unsigned int block = 0; block < count; block += DIFF_BLOCK) {
+    unsigned int block_end =
+        count - block > DIFF_BLOCK ? block + DIFF_BLOCK : count;
+    size_t offset = (size_t)block * element_size;
+
+    if (memcmp(old_bytes + offset, new_bytes + offset,
+               (size_t)(block_end - block) * element_size) != 0) {
+      unsigned int i = block;
+      while (i < block_end) {
+        size_t at = (size_t)i * element_size;
+        if (memcmp(old_bytes + at, new_bytes + at, element_size) != 0) {
+          unsigned int first = i;
+          while (i < block_end &&
+                 memcmp(old_bytes + (size_t)i * element_size,
+                        new_bytes + (size_t)i * element_size,
+                        element_size) != 0) {
+            i++;
+          }
+          add_range(ranges, first, i - first);
+        } else {
+          i++;
+        }
+      }
+    }
+  }
+}
+
+// Partial updates are only possible while every buffer keeps its size and
+// every polygon its corner count; anything else is a full reload.
+void diff_models(const Model1 *old_model, const Model1 *new_model,
+                 ModelDiff *diff) {
+  memset(diff, 0, sizeof(ModelDiff));
+
+  diff->layout_changed =
+      old_model->vertex_count != new_model->vertex_count ||
+      old_model->face_count != new_model->face_count ||
+      old_model->polygon_count != new_model->polygon_count ||
+      old_model->polygon_arity != new_model->polygon_arity ||
+      old_model->vertices == NULL ||
+      (new_model->polygon_offsets != NULL &&
+       memcmp(old_model->polygon_offsets, new_model->polygon_offsets,
+              sizeof(unsigned int) * (new_model->polygon_count + 1)) != 0);
+
+  if (!diff->layout_changed) {
+    diff_ranges(old_model->vertices, new_model->vertices,
+                new_model->vertex_count, sizeof(double) * 3, &diff->vertices);
+    diff_ranges(old_model->faces, new_model->faces, new_model->face_count,
+                sizeof(unsigned int), &diff->faces);
+  }
+}
+
+static void *copy_array(const void *source, size_t size, int *error_code) {
+  void *copy = NULL;
+
+  if (source != NULL && *error_code == OK) {
+    copy = memory_allocation(size + 1, "model copy");
+    if (copy == NULL) {
+      *error_code = ERROR;
+    } else {
+      memcpy(copy, source, size);
+    }
+  }
+
+  return copy;
+}
+
+int copy_model(const Model1 *source, Model1 *copy, ModelError *error) {
+  int error_code = OK;
+  size_t vertex_bytes = sizeof(double) * 3 * source->vertex_count;
+  size_t polygon_bytes =
+      source->polygon_offsets
+          ? sizeof(unsigned int) * (source->polygon_count + 1)
+          : 0;
+  size_t face_bytes = sizeof(unsigned int) * source->face_count;
+  size_t normal_bytes = sizeof(float) * 3 * source->normal_count;
+  size_t triangle_bytes = sizeof(unsigned int) * 3 * source->triangle_count;
+  size_t total =
+      vertex_bytes + polygon_bytes + face_bytes + normal_bytes + triangle_bytes;
+
+  memset(copy, 0, sizeof(Model1));
+  clear_model_error(error);
+  if (!memory_budget_allows(total)) {
+    set_model_error(error, MODEL_ERROR_BUDGET, 0,
+                    "Model copy exceeds the memory budget of %.1f MB",
+                    get_memory_budget() / MEGABYTE);
+    error_code = ERROR;
+  }
+
+  *copy = *source;
+  copy->memory_bytes = 0;
+  copy->vertices = copy_array(source->vertices, vertex_bytes, &error_code);
+  copy->polygon_offsets =
+      copy_array(source->polygon_offsets, polygon_bytes, &error_code);
+  copy->faces = copy_array(source->faces, face_bytes, &error_code);
+  copy->normals = copy_array(source->normals, normal_bytes, &error_code);
+  copy->triangles = copy_array(source->triangles, triangle_bytes, &error_code);
+
+  if (error_code == OK) {
+    update_model_memory(copy, total);
+  } else {
+    set_model_error(error, MODEL_ERROR_MEMORY, 0,
+                    "Not enough memory to copy the model");
+    free_model(copy);
+  }
+  return error_code;
+}
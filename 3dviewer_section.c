@@ -0,0 +1,259 @@
+#include "3dviewer.h"
+
+typedef struct section_job {
+  const Model1 *model;
+  const double *plane;
+  unsigned int *chunks;
+  unsigned int *counts;
+  float *points;
+  double *bounds;
+} SectionJob;
+
+static const double *corner_vertex(const Model1 *model, unsigned int face) {
+  unsigned int vertex = model->faces[face];
+  return vertex == 0 || vertex > model->vertex_count
+             ? NULL
+             : model->vertices + 3 * (vertex - 1);
+}
+
+static unsigned int chunk_end(const Model1 *model, unsigned int chunk) {
+  unsigned int end = (chunk + 1) * SECTION_CHUNK;
+  return end < model->polygon_count ? end : model->polygon_count;
+}
+
+static void compute_bounds(void *context, size_t begin, size_t end,
+                           unsigned int worker) {
+  SectionJob *job = context;
+  const Model1 *model = job->model;
+  (void)worker;
+
+  for (size_t chunk = begin; chunk < end; chunk++) {
+    double *bounds = job->bounds + 6 * chunk;
+    unsigned int first = polygon_start(model, chunk * SECTION_CHUNK);
+    unsigned int last = polygon_start(model, chunk_end(model, chunk));
+
+    for (int axis = 0; axis < 3; axis++) {
+      bounds[axis] = DBL_MAX;
+      bounds[3 + axis] = -DBL_MAX;
+    }
+    for (unsigned int face = first; face < last; face++) {
+      const double *v = corner_vertex(model, face);
+      for (int axis = 0; axis < 3 && v != NULL; axis++) {
+        bounds[axis] = fmin(bounds[axis], v[axis]);
+        bounds[3 + axis] = fmax(bounds[3 + axis], v[axis]);
+      }
+    }
+  }
+}
+
+int build_section_index(const Model1 *model, SectionIndex *index) {
+  int error_code = OK;
+  SectionJob job = {0};
+  unsigned int chunk_count =
+      (model->polygon_count + SECTION_CHUNK - 1) / SECTION_CHUNK;
+  size_t bytes = sizeof(double) * 6 * chunk_count;
+
+  free_section_index(index);
+  job.model = model;
+  job.bounds = memory_allocation(bytes + 1, "section bounds");
+  if (job.bounds == NULL) {
+    error_code = ERROR;
+  } else {
+    parallel_for(chunk_count, 1, compute_bounds, &job);
+    index->bounds = job.bounds;
+    index->chunk_count = chunk_count;
+    index->memory_bytes = bytes;
+    memory_track(MEMORY_SECTION, bytes);
+  }
+
+  return error_code;
+}
+
+void free_section_index(SectionIndex *index) {
+  memory_track(MEMORY_SECTION, -(long long)index->memory_bytes);
+  free(index->bounds);
+  memset(index, 0, sizeof(SectionIndex));
+}
+
+static double plane_distance(const double plane[4], const double *point) {
+  return plane[0] * point[0] + plane[1] * point[1] + plane[2] * point[2] +
+         plane[3];
+}
+
+// Corners with a distance >= 0 count as in front, so a corner on the plane
+// belongs to exactly one side and every crossed edge is seen once.
+static int chunk_crosses(const double plane[4], const double *bounds) {
+  double low = plane[3];
+  double high = plane[3];
+
+  for (int axis = 0; axis < 3; axis++) {
+    double a = plane[axis] * bounds[axis];
+    double b = plane[axis] * bounds[3 + axis];
+    low += fmin(a, b);
+    high += fmax(a, b);
+  }
+
+  return bounds[0] <= bounds[3] && low < 0 && high >= 0;
+}
+
+// Writes the crossing point of every crossed edge, in corner order, and
+// returns the number of segments: a convex polygon crosses the plane in one,
+// the crossings of a concave one are paired in corner order. A polygon with
+// a corner outside the vertex array is skipped.
+static unsigned int cross_polygon(const Model1 *model, const double plane[4],
+                                  unsigned int polygon, float *points) {
+  unsigned int first = polygon_start(model, polygon);
+  unsigned int size = polygon_size(model, polygon);
+  unsigned int crossings = 0;
+  int valid = size >= 3;
+
+  for (unsigned int i = 0; i < size && valid; i++) {
+    valid = corner_vertex(model, first + i) != NULL;
+  }
+  for (unsigned int i = 0; i < size && valid; i++) {
+    const double *a = corner_vertex(model, first + i);
+    const double *b = corner_vertex(model, first + (i + 1) % size);
+    double da = plane_distance(plane, a);
+    double db = plane_distance(plane, b);
+
+    if ((da < 0) != (db < 0)) {
+      if (points != NULL) {
+        double t = da / (da - db);
+        for (int axis = 0; axis < 3; axis++) {
+          points[3 * crossings + axis] = a[axis] + (b[axis] - a[axis]) * t;
+        }
+      }
+      crossings++;
+    }
+  }
+
+  return crossings / 2;
+}
+
+static void count_segments(void *context, size_t begin, size_t end,
+                           unsigned int worker) {
+  SectionJob *job = context;
+  (void)worker;
+
+  for (size_t k = begin; k < end; k++) {
+    unsigned int chunk = job->chunks[k];
+    unsigned int count = 0;
+    for (unsigned int p = chunk * SECTION_CHUNK;
+         p < chunk_end(job->model, chunk); p++) {
+      count += cross_polygon(job->model, job->plane, p, NULL);
+    }
+    job->counts[k] = count;
+  }
+}
+
+// Crossings come in pairs around a closed polygon, so each polygon writes
+// exactly the two points per segment that count_segments reserved.
+static void emit_segments(void *context, size_t begin, size_t end,
+                          unsigned int worker) {
+  SectionJob *job = context;
+  (void)worker;
+
+  for (size_t k = begin; k < end; k++) {
+    unsigned int chunk = job->chunks[k];
+    float *out = job->points + 6 * (size_t)job->counts[k];
+    for (unsigned int p = chunk * SECTION_CHUNK;
+         p < chunk_end(job->model, chunk); p++) {
+      out += 6 * cross_polygon(job->model, job->plane, p, out);
+    }
+  }
+}
+
+static int reserve_section_lines(SectionLines *lines, unsigned int segments) {
+  int error_code = OK;
+
+  if (segments > lines->capacity) {
+    unsigned int capacity = lines->capacity > 0 ? lines->capacity : 1024;
+    while (capacity < segments) capacity *= 2;
+    size_t bytes = sizeof(float) * 6 * capacity;
+    float *points = memory_allocation(bytes, "section lines");
+    if (points == NULL) {
+      error_code = ERROR;
+    } else {
+      free(lines->points);
+      memory_track(MEMORY_SECTION,
+                   (long long)bytes - (long long)lines->memory_bytes);
+      lines->points = points;
+      lines->capacity = capacity;
+      lines->memory_bytes = bytes;
+    }
+  }
+
+  return error_code;
+}
+
+// Only chunks whose bounds the plane crosses are visited: their segments
+// are counted in parallel, turned into offsets with a scan and written in
+// parallel again, in polygon order.
+int compute_section(const Model1 *model, const SectionIndex *index,
+                    const double plane[4], SectionLines *lines) {
+  int error_code = OK;
+  SectionJob job = {0};
+  unsigned int crossed = 0;
+
+  job.model = model;
+  job.plane = plane;
+  job.chunks =
+      memory_allocation(sizeof(unsigned int) * (index->chunk_count + 1),
+                        "section chunks");
+  job.counts =
+      memory_allocation(sizeof(unsigned int) * (index->chunk_count + 1),
+                        "section chunks");
+  if (job.chunks == NULL || job.counts == NULL) {
+    error_code = ERROR;
+  }
+
+  for (unsigned int c = 0; c < index->chunk_count && error_code == OK; c++) {
+    if (chunk_crosses(plane, index->bounds + 6 * c)) {
+      job.chunks[crossed++] = c;
+    }
+  }
+
+  if (error_code == OK) {
+    parallel_for(crossed, 1, count_segments, &job);
+    error_code = parallel_exclusive_scan(job.counts, crossed);
+  }
+  if (error_code == OK) {
+    error_code = reserve_section_lines(lines, job.counts[crossed]);
+  }
+  if (error_code == OK) {
+    job.points = lines->points;
+    parallel_for(crossed, 1, emit_segments, &job);
+    lines->segment_count = job.counts[crossed];
+  } else {
+    lines->segment_count = 0;
+  }
+
+  free(job.chunks);
+  free(job.counts);
+  return error_code;
+}
+
+void free_section_lines(SectionLines *lines) {
+  memory_track(MEMORY_SECTION, -(long long)lines->memory_bytes);
+  free(lines->points);
+  memset(lines, 0, sizeof(SectionLines));
+}
+
+// Keeps the side where the coordinate on axis is at most offset; the plane
+// is written as clip distance coefficients for gl_ClipDistance.
+void section_plane(int axis, double offset, double plane[4]) {
+  for (int i = 0; i < 3; i++) plane[i] = i == axis ? -1.0 : 0.0;
+  plane[3] = offset;
+}
+
+// Range of the model along axis, from the chunk bounds; [0, 0] when the
+// index has no corners.
+void section_extent(const SectionIndex *index, int axis, double extent[2]) {
+  extent[0] = DBL_MAX;
+  extent[1] = -DBL_MAX;
+  for (unsigned int c = 0; c < index->chunk_count; c++) {
+    extent[0] = fmin(extent[0], index->bounds[6 * c + axis]);
+    extent[1] = fmax(extent[1], index->bounds[6 * c + 3 + axis]);
+  }
+  if (extent[0] > extent[1]) extent[0] = extent[1] = 0;
+}
@@ -1,10 +1,15 @@
+#include <errno.h>
+#include <sys/stat.h>
+
 #include "3dviewer.h"
 
 void save_settings(const Settings *settings) {
   char settings_path[PATH_MAX];
-  get_settings_path(settings_path);
+  FILE *file = NULL;
 
-  FILE *file = fopen(settings_path, "w");
+  if (get_settings_path(settings_path) == OK) {
+    file = fopen(settings_path, "w");
+  }
 
   if (file == NULL) {
     fprintf(stderr, "Error saving configuration file\n");
@@ -27,6 +32,11 @@ void save_settings(const Settings *settings) {
             settings->background_color.red, settings->background_color.green,
             settings->background_color.blue, settings->background_color.alpha);
 
+    fprintf(file, "MemoryBudget=%f\n", settings->memory_budget);
+    fprintf(file, "MemoryPolicy=%d\n", settings->memory_policy);
+    fprintf(file, "DisplayMode=%d\n", settings->display_mode);
+    fprintf(file, "AutoReload=%d\n", settings->auto_reload);
+
     fclose(file);
   }
 }
@@ -35,9 +45,11 @@ void load_settings(Settings *settings) {
   set_default_settings(settings);
 
   char settings_path[PATH_MAX];
-  get_settings_path(settings_path);
+  FILE *file = NULL;
 
-  FILE *file = fopen(settings_path, "r");
+  if (get_settings_path(settings_path) == OK) {
+    file = fopen(settings_path, "r");
+  }
 
   if (file == NULL) {
     fprintf(stderr, "Error loading configuration file\n");
@@ -70,6 +82,11 @@ void load_settings(Settings *settings) {
     settings->background_color.blue = b;
     settings->background_color.alpha = a;
 
+    fscanf(file, "MemoryBudget=%lf\n", &settings->memory_budget);
+    fscanf(file, "MemoryPolicy=%d\n", (int *)&settings->memory_policy);
+    fscanf(file, "DisplayMode=%d\n", (int *)&settings->display_mode);
+    fscanf(file, "AutoReload=%d\n", &settings->auto_reload);
+
     fclose(file);
   }
 }
@@ -92,18 +109,54 @@ void set_default_settings(Settings *settings) {
   settings->background_color.green = 0.0;
   settings->background_color.blue = 0.0;
   settings->background_color.alpha = 1.0;
+  settings->memory_budget = 0.0;
+  settings->memory_policy = MEMORY_FLOAT_FALLBACK;
+  settings->display_mode = DISPLAY_WIREFRAME;
+  settings->auto_reload = 0;
 }
 
-int get_settings_path(char *settings_path) {
+static int make_directories(char *path) {
   int error_code = OK;
-  const char *dir = "build";
 
-  if (dir) {
-    sprintf(settings_path, "%s/%s", dir, SETTINGS_CONFIG);
+  for (char *ptr = path + 1; *ptr != '\0' && error_code == OK; ptr++) {
+    if (*ptr == '/') {
+      *ptr = '\0';
+      if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+        error_code = ERROR;
+      }
+      *ptr = '/';
+    }
+  }
+  if (error_code == OK && mkdir(path, 0755) != 0 && errno != EEXIST) {
+    error_code = ERROR;
+  }
+
+  return error_code;
+}
+
+int get_settings_path(char *settings_path) {
+  int error_code = OK;
+  const char *config_home = getenv("XDG_CONFIG_HOME");
+  const char *home = getenv("HOME");
+  char dir[PATH_MAX];
+
+  if (config_home && *config_home) {
+    snprintf(dir, sizeof(dir), "%s/%s", config_home, PROGRAM_NAME);
+  } else if (home) {
+    snprintf(dir, sizeof(dir), "%s/.config/%s", home, PROGRAM_NAME);
   } else {
     fprintf(stderr, "Error getting home directory\n");
     error_code = ERROR;
   }
 
+  if (error_code == OK && make_directories(dir) != OK) {
+    fprintf(stderr, "Error creating configuration directory: %s\n", dir);
+    error_code = ERROR;
+  }
+
+  if (error_code == OK) {
+    snprintf(settings_path, PATH_MAX, "%s/%s", dir, SETTINGS_CONFIG);
+  }
+
   return error_code;
-}
\ No newline at end of file
+}
@@ -0,0 +1,158 @@
+#include <epoxy/gl.h>
+#include <gtk/gtk.h>
+
+#include "3dviewer.h"
+
+static char *lookup_shader_source(const char *name, const char *extension) {
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/shaders/%s.%s", RESOURCE_PREFIX, name,
+           extension);
+
+  char *source = NULL;
+  GBytes *bytes = g_resources_lookup_data(path, G_RESOURCE_LOOKUP_FLAGS_NONE,
+                                          NULL);
+  if (bytes == NULL) {
+    fprintf(stderr, "Missing shader resource: %s\n", path);
+  } else {
+    source = g_strdup(g_bytes_get_data(bytes, NULL));
+    g_bytes_unref(bytes);
+  }
+
+  return source;
+}
+
+static GLuint compile_shader(GLenum type, const char *source) {
+  GLuint shader = glCreateShader(type);
+  glShaderSource(shader, 1, &source, NULL);
+  glCompileShader(shader);
+
+  GLint status = GL_FALSE;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+  if (status != GL_TRUE) {
+    char log[1024];
+    glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+    fprintf(stderr, "Shader compilation failed: %s\n", log);
+  }
+
+  return shader;
+}
+
+static gboolean program_binary_supported(void) {
+  GLint formats = 0;
+  if (epoxy_gl_version() >= 41 ||
+      epoxy_has_gl_extension("GL_ARB_get_program_binary")) {
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  }
+  return formats > 0;
+}
+
+// The cached binary is only valid for the exact driver and sources it was
+// built from, so both are part of the file name.
+static char *get_program_cache_path(const char *name, const char *vertex,
+                                    const char *fragment) {
+  const char *parts[] = {(const char *)glGetString(GL_VENDOR),
+                         (const char *)glGetString(GL_RENDERER),
+                         (const char *)glGetString(GL_VERSION), vertex,
+                         fragment};
+  guint64 hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < sizeof(parts) / sizeof(parts[0]); i++) {
+    for (const char *c = parts[i] ? parts[i] : ""; *c; c++) {
+      hash = (hash ^ (unsigned char)*c) * 1099511628211ULL;
+    }
+  }
+
+  char file_name[128];
+  snprintf(file_name, sizeof(file_name), "%s-%016llx.bin", name,
+           (unsigned long long)hash);
+  return g_build_filename(g_get_user_cache_dir(), PROGRAM_NAME, file_name,
+                          NULL);
+}
+
+static gboolean load_program_binary(GLuint program, const char *cache_path) {
+  gboolean loaded = FALSE;
+  char *contents = NULL;
+  gsize length = 0;
+
+  if (g_file_get_contents(cache_path, &contents, &length, NULL) &&
+      length > sizeof(GLenum)) {
+    GLenum format;
+    memcpy(&format, contents, sizeof(format));
+    glProgramBinary(program, format, contents + sizeof(format),
+                    length - sizeof(format));
+
+    GLint status = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    loaded = status == GL_TRUE;
+  }
+  g_free(contents);
+
+  return loaded;
+}
+
+static void save_program_binary(GLuint program, const char *cache_path) {
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+
+  if (length > 0) {
+    char *contents = g_malloc(sizeof(GLenum) + length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, NULL, &format,
+                       contents + sizeof(format));
+    memcpy(contents, &format, sizeof(format));
+
+    char *directory = g_path_get_dirname(cache_path);
+    g_mkdir_with_parents(directory, 0700);
+    if (!g_file_set_contents(cache_path, contents, sizeof(format) + length,
+                             NULL)) {
+      fprintf(stderr, "Could not write shader cache: %s\n", cache_path);
+    }
+    g_free(directory);
+    g_free(contents);
+  }
+}
+
+unsigned int load_shader_program(const char *name) {
+  char *vertex_source = lookup_shader_source(name, "vert");
+  char *fragment_source = lookup_shader_source(name, "frag");
+  GLuint program = glCreateProgram();
+  gboolean use_cache = program_binary_supported();
+  char *cache_path = NULL;
+  gboolean linked = FALSE;
+
+  if (use_cache) {
+    cache_path = get_program_cache_path(name, vertex_source, fragment_source);
+    linked = load_program_binary(program, cache_path);
+  }
+
+  if (!linked && vertex_source && fragment_source) {
+    if (use_cache) {
+      glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                          GL_TRUE);
+    }
+    GLuint vertex_shader = compile_shader(GL_VERTEX_SHADER, vertex_source);
+    GLuint fragment_shader =
+        compile_shader(GL_FRAGMENT_SHADER, fragment_source);
+    glAttachShader(program, vertex_shader);
+    glAttachShader(program, fragment_shader);
+    glLinkProgram(program);
+    glDetachShader(program, vertex_shader);
+    glDetachShader(program, fragment_shader);
+    glDeleteShader(vertex_shader);
+    glDeleteShader(fragment_shader);
+
+    GLint status = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+      char log[1024];
+      glGetProgramInfoLog(program, sizeof(log), NULL, log);
+      fprintf(stderr, "Shader program link failed: %s\n", log);
+    } else if (use_cache) {
+      save_program_binary(program, cache_path);
+    }
+  }
+
+  g_free(cache_path);
+  g_free(vertex_source);
+  g_free(fragment_source);
+  return program;
+}
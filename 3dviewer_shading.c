@@ -0,0 +1,345 @@
+#include <stdatomic.h>
+
+#include "3dviewer.h"
+
+typedef struct shading_job {
+  Model1 *model;
+  unsigned int *triangle_start;
+  float *face_normals;
+  unsigned int *corner_start;
+  atomic_uint *corner_fill;
+  unsigned int *corners;
+} ShadingJob;
+
+static void count_triangles(void *context, size_t begin, size_t end,
+                            unsigned int worker) {
+  ShadingJob *job = context;
+  const Model1 *model = job->model;
+  (void)worker;
+
+  for (size_t p = begin; p < end; p++) {
+    unsigned int first = polygon_start(model, p);
+    unsigned int last = first + polygon_size(model, p);
+    int valid = last - first >= 3;
+
+    for (unsigned int i = first; i < last && valid; i++) {
+      valid = model->faces[i] > 0 && model->faces[i] <= model->vertex_count;
+    }
+    job->triangle_start[p] = valid ? last - first - 2 : 0;
+  }
+}
+
+// Fan triangulation; polygons with fewer than three corners or with indices
+// outside the vertex array produce no triangles.
+static void emit_triangles(void *context, size_t begin, size_t end,
+                           unsigned int worker) {
+  ShadingJob *job = context;
+  Model1 *model = job->model;
+  (void)worker;
+
+  for (size_t p = begin; p < end; p++) {
+    unsigned int first = polygon_start(model, p);
+    unsigned int *triangle = model->triangles + 3 * job->triangle_start[p];
+    unsigned int count = job->triangle_start[p + 1] - job->triangle_start[p];
+
+    for (unsigned int i = 0; i < count; i++) {
+      *triangle++ = model->faces[first] - 1;
+      *triangle++ = model->faces[first + i + 1] - 1;
+      *triangle++ = model->faces[first + i + 2] - 1;
+    }
+  }
+}
+
+int triangulate_model(Model1 *model) {
+  int error_code = OK;
+  ShadingJob job = {model, NULL, NULL, NULL, NULL, NULL};
+  size_t offsets = sizeof(unsigned int) * (model->polygon_count + 1);
+
+  free(model->triangles);
+  model->triangles = NULL;
+  model->triangle_count = 0;
+
+  job.triangle_start = memory_allocation(offsets, "triangulation offsets");
+  if (!job.triangle_start ||
+      polygon_start(model, model->polygon_count) != model->face_count) {
+    error_code = ERROR;
+  }
+
+  if (error_code == OK) {
+    parallel_for(model->polygon_count, PARALLEL_GRAIN, count_triangles, &job);
+    error_code =
+        parallel_exclusive_scan(job.triangle_start, model->polygon_count);
+  }
+
+  if (error_code == OK) {
+    model->triangle_count = job.triangle_start[model->polygon_count];
+    model->triangles = memory_allocation(
+        sizeof(unsigned int) * 3 * model->triangle_count + 1,
+        "model.triangles");
+    if (model->triangles == NULL) {
+      model->triangle_count = 0;
+      error_code = ERROR;
+    }
+  }
+
+  if (error_code == OK) {
+    parallel_for(model->polygon_count, PARALLEL_GRAIN, emit_triangles, &job);
+  }
+
+  free(job.triangle_start);
+  return error_code;
+}
+
+// Area-weighted face normals: the cross product is left unnormalized so
+// that large triangles dominate the vertex normals around them.
+static void compute_face_normals(void *context, size_t begin, size_t end,
+                                 unsigned int worker) {
+  ShadingJob *job = context;
+  const double *vertices = job->model->vertices;
+  const unsigned int *triangles = job->model->triangles;
+  float *normals = job->face_normals;
+  (void)worker;
+
+  for (size_t t = begin; t < end; t++) {
+    const double *a = vertices + 3 * triangles[3 * t];
+    const double *b = vertices + 3 * triangles[3 * t + 1];
+    const double *c = vertices + 3 * triangles[3 * t + 2];
+    double u[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+    double v[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+
+    normals[3 * t] = u[1] * v[2] - u[2] * v[1];
+    normals[3 * t + 1] = u[2] * v[0] - u[0] * v[2];
+    normals[3 * t + 2] = u[0] * v[1] - u[1] * v[0];
+  }
+}
+
+static void count_corners(void *context, size_t begin, size_t end,
+                          unsigned int worker) {
+  ShadingJob *job = context;
+  (void)worker;
+
+  for (size_t i = begin; i < end; i++) {
+    atomic_fetch_add_explicit(&job->corner_fill[job->model->triangles[i]], 1,
+                              memory_order_relaxed);
+  }
+}
+
+static void copy_corner_counts(void *context, size_t begin, size_t end,
+                               unsigned int worker) {
+  ShadingJob *job = context;
+  (void)worker;
+
+  for (size_t v = begin; v < end; v++) {
+    job->corner_start[v] =
+        atomic_load_explicit(&job->corner_fill[v], memory_order_relaxed);
+  }
+}
+
+static void clear_corner_fill(void *context, size_t begin, size_t end,
+                              unsigned int worker) {
+  ShadingJob *job = context;
+  (void)worker;
+
+  for (size_t v = begin; v < end; v++) {
+    atomic_store_explicit(&job->corner_fill[v], 0, memory_order_relaxed);
+  }
+}
+
+static void reset_corner_fill(void *context, size_t begin, size_t end,
+                              unsigned int worker) {
+  ShadingJob *job = context;
+  (void)worker;
+
+  for (size_t v = begin; v < end; v++) {
+    atomic_store_explicit(&job->corner_fill[v], job->corner_start[v],
+                          memory_order_relaxed);
+  }
+}
+
+static void scatter_corners(void *context, size_t begin, size_t end,
+                            unsigned int worker) {
+  ShadingJob *job = context;
+  (void)worker;
+
+  for (size_t i = begin; i < end; i++) {
+    unsigned int slot = atomic_fetch_add_explicit(
+        &job->corner_fill[job->model->triangles[i]], 1, memory_order_relaxed);
+    job->corners[slot] = i / 3;
+  }
+}
+
+static int compare_indices(const void *left, const void *right) {
+  unsigned int a = *(const unsigned int *)left;
+  unsigned int b = *(const unsigned int *)right;
+  return (a > b) - (a < b);
+}
+
+// Each vertex sums the normals of its own triangles, in triangle order so
+// that the result does not depend on the thread count.
+static void gather_vertex_normals(void *context, size_t begin, size_t end,
+                                  unsigned int worker) {
+  ShadingJob *job = context;
+  float *normals = job->model->normals;
+  (void)worker;
+
+  for (size_t v = begin; v < end; v++) {
+    unsigned int *corners = job->corners + job->corner_start[v];
+    unsigned int size = job->corner_start[v + 1] - job->corner_start[v];
+    double sum[3] = {0};
+
+    if (size <= SMALL_BUCKET) {
+      for (unsigned int i = 1; i < size; i++) {
+        unsigned int corner = corners[i];
+        unsigned int j = i;
+        for (; j > 0 && corners[j - 1] > corner; j--) {
+          corners[j] = corners[j - 1];
+        }
+        corners[j] = corner;
+      }
+    } else {
+      qsort(corners, size, sizeof(unsigned int), compare_indices);
+    }
+
+    for (unsigned int i = 0; i < size; i++) {
+      const float *face = job->face_normals + 3 * corners[i];
+      sum[0] += face[0];
+      sum[1] += face[1];
+      sum[2] += face[2];
+    }
+
+    double length = sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+    if (length > 0) {
+      normals[3 * v] = sum[0] / length;
+      normals[3 * v + 1] = sum[1] / length;
+      normals[3 * v + 2] = sum[2] / length;
+    } else {
+      normals[3 * v] = 0.0f;
+      normals[3 * v + 1] = 0.0f;
+      normals[3 * v + 2] = 1.0f;
+    }
+  }
+}
+
+static void normalize_normals(void *context, size_t begin, size_t end,
+                              unsigned int worker) {
+  ShadingJob *job = context;
+  float *normals = job->model->normals;
+  (void)worker;
+
+  for (size_t v = begin; v < end; v++) {
+    float *n = normals + 3 * v;
+    float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (length > 0) {
+      n[0] /= length;
+      n[1] /= length;
+      n[2] /= length;
+    } else {
+      n[2] = 1.0f;
+    }
+  }
+}
+
+static int file_normals_usable(const Model1 *model) {
+  return model->normals != NULL && model->normal_count == model->vertex_count &&
+         !model->normal_index_mismatch;
+}
+
+int compute_normals(Model1 *model) {
+  int error_code = OK;
+  ShadingJob job = {model, NULL, NULL, NULL, NULL, NULL};
+  size_t corner_count = (size_t)model->triangle_count * 3;
+
+  if (file_normals_usable(model)) {
+    parallel_for(model->vertex_count, PARALLEL_GRAIN, normalize_normals,
+                 &job);
+  } else {
+    free(model->normals);
+    model->normal_count = 0;
+    model->normals = memory_allocation(
+        sizeof(float) * 3 * model->vertex_count + 1, "model.normals");
+    job.face_normals = memory_allocation(
+        sizeof(float) * 3 * model->triangle_count + 1, "face normals");
+    job.corner_start = memory_allocation(
+        sizeof(unsigned int) * (model->vertex_count + 1), "normal corners");
+    job.corner_fill = memory_allocation(
+        sizeof(atomic_uint) * model->vertex_count + 1, "normal corners");
+    job.corners =
+        memory_allocation(sizeof(unsigned int) * corner_count + 1,
+                          "normal corners");
+    if (!model->normals || !job.face_normals || !job.corner_start ||
+        !job.corner_fill || !job.corners) {
+      error_code = ERROR;
+    }
+
+    // Triangles are grouped by vertex with a counting sort, so every vertex
+    // normal is a gather over its own triangles and needs no atomics.
+    if (error_code == OK) {
+      parallel_for(model->vertex_count, PARALLEL_GRAIN, clear_corner_fill,
+                   &job);
+      parallel_for(model->triangle_count, PARALLEL_GRAIN,
+                   compute_face_normals, &job);
+      parallel_for(corner_count, PARALLEL_GRAIN, count_corners, &job);
+      parallel_for(model->vertex_count, PARALLEL_GRAIN, copy_corner_counts,
+                   &job);
+      error_code =
+          parallel_exclusive_scan(job.corner_start, model->vertex_count);
+    }
+
+    if (error_code == OK) {
+      parallel_for(model->vertex_count, PARALLEL_GRAIN, reset_corner_fill,
+                   &job);
+      parallel_for(corner_count, PARALLEL_GRAIN, scatter_corners, &job);
+      parallel_for(model->vertex_count, PARALLEL_GRAIN, gather_vertex_normals,
+                   &job);
+      model->normal_count = model->vertex_count;
+    }
+
+    free(job.face_normals);
+    free(job.corner_start);
+    free(job.corner_fill);
+    free(job.corners);
+  }
+
+  return error_code;
+}
+
+int prepare_shading(Model1 *model, ModelError *error) {
+  int error_code = OK;
+  // A fan never has more triangles than its polygon has corners.
+  size_t triangle_bytes = sizeof(unsigned int) * 3 * model->face_count;
+  size_t normal_bytes = sizeof(float) * 3 * model->vertex_count;
+  size_t scratch_bytes = sizeof(unsigned int) * (2 * model->polygon_count +
+                                                 2 * model->vertex_count) +
+                         2 * triangle_bytes;
+  size_t old_normal_bytes = sizeof(float) * 3 * model->normal_count;
+
+  clear_model_error(error);
+  if (!memory_budget_allows(triangle_bytes + normal_bytes + scratch_bytes)) {
+    set_model_error(error, MODEL_ERROR_BUDGET, 0,
+                    "Shading needs %.1f MB, memory budget is %.1f MB",
+                    (triangle_bytes + normal_bytes + scratch_bytes) / MEGABYTE,
+                    get_memory_budget() / MEGABYTE);
+    error_code = ERROR;
+  }
+
+  if (error_code == OK) {
+    error_code = triangulate_model(model);
+  }
+  if (error_code == OK) {
+    error_code = compute_normals(model);
+  }
+
+  if (error_code != OK) {
+    set_model_error(error, MODEL_ERROR_MEMORY, 0,
+                    "Not enough memory for shading");
+    free(model->triangles);
+    model->triangles = NULL;
+    model->triangle_count = 0;
+  }
+  update_model_memory(
+      model, model->memory_bytes - old_normal_bytes +
+                 sizeof(float) * 3 * model->normal_count +
+                 sizeof(unsigned int) * 3 * model->triangle_count);
+
+  return error_code;
+}
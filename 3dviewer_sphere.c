@@ -0,0 +1,203 @@
+#include "3dviewer.h"
+
+// Vertices are split into fixed blocks of SPHERE_BLOCK, so every pass visits
+// the same points in the same order whatever the number of workers.
+typedef struct sphere_block {
+  unsigned int extremes[6];  // lowest x, y, z vertex then highest
+  BoundingSphere sphere;
+  double distance;
+} SphereBlock;
+
+typedef struct sphere_job {
+  const Model1 *model;
+  SphereBlock *blocks;
+  BoundingSphere initial;
+} SphereJob;
+
+static const double *sphere_vertex(const Model1 *model, unsigned int index) {
+  return model->vertices + 3 * (size_t)index;
+}
+
+static double squared_distance(const double *a, const double *b) {
+  double dx = a[0] - b[0];
+  double dy = a[1] - b[1];
+  double dz = a[2] - b[2];
+  return dx * dx + dy * dy + dz * dz;
+}
+
+static unsigned int block_end(const Model1 *model, size_t block) {
+  size_t end = (block + 1) * SPHERE_BLOCK;
+  return end < model->vertex_count ? end : model->vertex_count;
+}
+
+static void find_extremes(void *context, size_t begin, size_t end,
+                          unsigned int worker) {
+  SphereJob *job = context;
+  const Model1 *model = job->model;
+  (void)worker;
+
+  for (size_t b = begin; b < end; b++) {
+    unsigned int *extremes = job->blocks[b].extremes;
+    unsigned int first = b * SPHERE_BLOCK;
+
+    for (int i = 0; i < 6; i++) extremes[i] = first;
+    for (unsigned int v = first + 1; v < block_end(model, b); v++) {
+      const double *point = sphere_vertex(model, v);
+      for (int axis = 0; axis < 3; axis++) {
+        if (point[axis] < sphere_vertex(model, extremes[axis])[axis]) {
+          extremes[axis] = v;
+        }
+        if (point[axis] > sphere_vertex(model, extremes[3 + axis])[axis]) {
+          extremes[3 + axis] = v;
+        }
+      }
+    }
+  }
+}
+
+// Ritter's pass: every point outside the sphere pulls it just far enough to
+// cover the point and still cover the old sphere.
+static void grow_sphere(BoundingSphere *sphere, const double *point) {
+  double distance = sqrt(squared_distance(point, sphere->center));
+
+  if (distance > sphere->radius) {
+    double radius = (sphere->radius + distance) / 2;
+    double shift = (distance - radius) / distance;
+    for (int axis = 0; axis < 3; axis++) {
+      sphere->center[axis] += (point[axis] - sphere->center[axis]) * shift;
+    }
+    sphere->radius = radius;
+  }
+}
+
+static void grow_blocks(void *context, size_t begin, size_t end,
+                        unsigned int worker) {
+  SphereJob *job = context;
+  (void)worker;
+
+  for (size_t b = begin; b < end; b++) {
+    BoundingSphere sphere = job->initial;
+    for (unsigned int v = b * SPHERE_BLOCK; v < block_end(job->model, b);
+         v++) {
+      grow_sphere(&sphere, sphere_vertex(job->model, v));
+    }
+    job->blocks[b].sphere = sphere;
+  }
+}
+
+static void farthest_in_blocks(void *context, size_t begin, size_t end,
+                               unsigned int worker) {
+  SphereJob *job = context;
+  (void)worker;
+
+  for (size_t b = begin; b < end; b++) {
+    double distance = 0;
+    for (unsigned int v = b * SPHERE_BLOCK; v < block_end(job->model, b);
+         v++) {
+      distance = fmax(distance, squared_distance(sphere_vertex(job->model, v),
+                                                 job->initial.center));
+    }
+    job->blocks[b].distance = distance;
+  }
+}
+
+// Smallest sphere holding both spheres.
+static BoundingSphere merge_spheres(BoundingSphere a, BoundingSphere b) {
+  BoundingSphere merged = a;
+  double distance = sqrt(squared_distance(a.center, b.center));
+
+  if (distance + a.radius <= b.radius) {
+    merged = b;
+  } else if (distance + b.radius > a.radius) {
+    merged.radius = (distance + a.radius + b.radius) / 2;
+    for (int axis = 0; axis < 3; axis++) {
+      merged.center[axis] +=
+          (b.center[axis] - a.center[axis]) * (merged.radius - a.radius) /
+          distance;
+    }
+  }
+
+  return merged;
+}
+
+// Ritter's bounding sphere, at most a few percent larger than the minimal
+// one. The sphere through the farthest pair of axis extremes is grown over
+// every block in parallel, the block spheres are merged in block order and
+// the radius is finally shrunk to the farthest vertex from the center.
+int bounding_sphere(const Model1 *model, BoundingSphere *sphere) {
+  int error_code = OK;
+  SphereJob job = {0};
+  size_t block_count = (model->vertex_count + SPHERE_BLOCK - 1) / SPHERE_BLOCK;
+
+  memset(sphere, 0, sizeof(BoundingSphere));
+  job.model = model;
+  job.blocks = memory_allocation(sizeof(SphereBlock) * (block_count + 1),
+                                 "bounding sphere");
+  if (job.blocks == NULL) error_code = ERROR;
+
+  if (error_code == OK && block_count > 0) {
+    unsigned int extremes[6];
+    parallel_for(block_count, 1, find_extremes, &job);
+    memcpy(extremes, job.blocks[0].extremes, sizeof(extremes));
+    for (size_t b = 1; b < block_count; b++) {
+      for (int axis = 0; axis < 3; axis++) {
+        const unsigned int *block = job.blocks[b].extremes;
+        if (sphere_vertex(model, block[axis])[axis] <
+            sphere_vertex(model, extremes[axis])[axis]) {
+          extremes[axis] = block[axis];
+        }
+        if (sphere_vertex(model, block[3 + axis])[axis] >
+            sphere_vertex(model, extremes[3 + axis])[axis]) {
+          extremes[3 + axis] = block[3 + axis];
+        }
+      }
+    }
+
+    int widest = 0;
+    double widest_distance = -1;
+    for (int axis = 0; axis < 3; axis++) {
+      double distance =
+          squared_distance(sphere_vertex(model, extremes[axis]),
+                           sphere_vertex(model, extremes[3 + axis]));
+      if (distance > widest_distance) {
+        widest = axis;
+        widest_distance = distance;
+      }
+    }
+    const double *low = sphere_vertex(model, extremes[widest]);
+    const double *high = sphere_vertex(model, extremes[3 + widest]);
+    for (int axis = 0; axis < 3; axis++) {
+      job.initial.center[axis] = (low[axis] + high[axis]) / 2;
+    }
+    job.initial.radius = sqrt(widest_distance) / 2;
+
+    parallel_for(block_count, 1, grow_blocks, &job);
+    *sphere = job.blocks[0].sphere;
+    for (size_t b = 1; b < block_count; b++) {
+      *sphere = merge_spheres(*sphere, job.blocks[b].sphere);
+    }
+
+    job.initial = *sphere;
+    parallel_for(block_count, 1, farthest_in_blocks, &job);
+    double farthest = 0;
+    for (size_t b = 0; b < block_count; b++) {
+      farthest = fmax(farthest, job.blocks[b].distance);
+    }
+    sphere->radius = sqrt(farthest);
+  }
+
+  free(job.blocks);
+  return error_code;
+}
+
+// Move, Rotate and Scale are rigid motions and uniform scales, so the cached
+// sphere follows the model without a new pass over the vertices.
+void transform_sphere(BoundingSphere *sphere, Matrix matrix) {
+  double center[4] = {sphere->center[0], sphere->center[1], sphere->center[2],
+                      1.0};
+  double result[4] = {0};
+
+  mult_matrix(matrix, center, result);
+  memcpy(sphere->center, result, sizeof(sphere->center));
+  sphere->radius *= transform_scale(matrix);
+}
@@ -0,0 +1,456 @@
+#include <zlib.h>
+
+#include "3dviewer.h"
+#ifdef VIEWER_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+Compression detect_compression(const char *filename) {
+  Compression compression = COMPRESSION_NONE;
+  unsigned char magic[4] = {0};
+  FILE *file = fopen(filename, "rb");
+
+  if (file != NULL) {
+    size_t size = fread(magic, 1, sizeof(magic), file);
+    if (size >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+      compression = COMPRESSION_GZIP;
+    } else if (size == 4 && magic[0] == 0x28 && magic[1] == 0xb5 &&
+               magic[2] == 0x2f && magic[3] == 0xfd) {
+      compression = COMPRESSION_ZSTD;
+    }
+    fclose(file);
+  }
+
+  return compression;
+}
+
+int load_compressed_model(const char *filename, Compression compression,
+                          Model1 *model, ModelError *error) {
+  StreamReader reader;
+  char line[MAX_LINE_LENGTH];
+  ParseContext context = {0};
+
+  int error_code = stream_open(&reader, filename, compression, error);
+
+  if (error_code == OK) {
+    context.model = model;
+    context.error = error;
+    error_code = parse_stream(&reader, line, &context);
+    stream_close(&reader);
+  }
+
+  return error_code;
+}
+
+// Producer side: waits for a free chunk, NULL once the reader is cancelled.
+static StreamChunk *stream_acquire_free(StreamReader *reader) {
+  StreamChunk *chunk = NULL;
+
+  pthread_mutex_lock(&reader->mutex);
+  while (reader->filled == STREAM_CHUNK_COUNT && !reader->cancelled) {
+    pthread_cond_wait(&reader->not_full, &reader->mutex);
+  }
+  if (!reader->cancelled) {
+    chunk = &reader->chunks[reader->tail];
+  }
+  pthread_mutex_unlock(&reader->mutex);
+
+  return chunk;
+}
+
+static void stream_commit(StreamReader *reader) {
+  pthread_mutex_lock(&reader->mutex);
+  reader->tail = (reader->tail + 1) % STREAM_CHUNK_COUNT;
+  reader->filled += 1;
+  pthread_cond_signal(&reader->not_empty);
+  pthread_mutex_unlock(&reader->mutex);
+}
+
+static void stream_finish(StreamReader *reader, int error_code) {
+  pthread_mutex_lock(&reader->mutex);
+  reader->finished = 1;
+  reader->error_code = error_code;
+  pthread_cond_broadcast(&reader->not_empty);
+  pthread_mutex_unlock(&reader->mutex);
+}
+
+// Called after a gzip member ends: moves the unread input to the front of
+// the buffer and tops it up, so the next member's magic can be checked even
+// when it straddles two reads.
+static int gzip_member_follows(StreamReader *reader, z_stream *zs,
+                               unsigned char *input) {
+  memmove(input, zs->next_in, zs->avail_in);
+  zs->next_in = input;
+  if (zs->avail_in < 2) {
+    zs->avail_in += fread(input + zs->avail_in, 1,
+                          STREAM_INPUT_SIZE - zs->avail_in, reader->file);
+  }
+
+  return zs->avail_in >= 2 && input[0] == 0x1f && input[1] == 0x8b;
+}
+
+static void *gzip_worker(void *arg) {
+  StreamReader *reader = arg;
+  unsigned char input[STREAM_INPUT_SIZE];
+  z_stream zs = {0};
+  int error_code = inflateInit2(&zs, 15 + 32) == Z_OK ? OK : ERROR;
+  int stream_ended = 0;
+  int done = 0;
+
+  while (error_code == OK && !done) {
+    StreamChunk *chunk = stream_acquire_free(reader);
+    if (chunk == NULL) {
+      done = 1;
+    } else {
+      zs.next_out = (Bytef *)chunk->data;
+      zs.avail_out = STREAM_CHUNK_SIZE;
+
+      while (zs.avail_out > 0 && !done && error_code == OK) {
+        if (zs.avail_in == 0) {
+          zs.avail_in = fread(input, 1, sizeof(input), reader->file);
+          zs.next_in = input;
+          if (zs.avail_in == 0) {
+            done = 1;
+            if (ferror(reader->file) || !stream_ended) {
+              set_model_error(&reader->error, MODEL_ERROR_TRUNCATED, 0,
+                              "Truncated or unreadable gzip stream");
+              error_code = ERROR;
+            }
+          }
+        }
+        if (!done) {
+          int status = inflate(&zs, Z_NO_FLUSH);
+          if (status == Z_STREAM_END) {
+            // Concatenated gzip members are decoded as one stream; anything
+            // else after a member is padding and ends the stream.
+            stream_ended = 1;
+            if (gzip_member_follows(reader, &zs, input)) {
+              inflateReset(&zs);
+            } else {
+              done = 1;
+              if (ferror(reader->file)) {
+                set_model_error(&reader->error, MODEL_ERROR_TRUNCATED, 0,
+                                "Truncated or unreadable gzip stream");
+                error_code = ERROR;
+              }
+            }
+          } else if (status == Z_OK) {
+            stream_ended = 0;
+          } else if (status != Z_BUF_ERROR) {
+            set_model_error(&reader->error, MODEL_ERROR_FORMAT, 0,
+                            "Corrupted gzip stream");
+            error_code = ERROR;
+          }
+        }
+      }
+
+      chunk->size = STREAM_CHUNK_SIZE - zs.avail_out;
+      stream_commit(reader);
+    }
+  }
+
+  inflateEnd(&zs);
+  stream_finish(reader, error_code);
+  return NULL;
+}
+
+#ifdef VIEWER_WITH_ZSTD
+static void *zstd_worker(void *arg) {
+  StreamReader *reader = arg;
+  unsigned char input[STREAM_INPUT_SIZE];
+  ZSTD_DStream *zs = ZSTD_createDStream();
+  ZSTD_inBuffer in = {input, 0, 0};
+  int error_code = zs != NULL ? OK : ERROR;
+  size_t frame_left = 0;
+  int done = 0;
+
+  while (error_code == OK && !done) {
+    StreamChunk *chunk = stream_acquire_free(reader);
+    if (chunk == NULL) {
+      done = 1;
+    } else {
+      ZSTD_outBuffer out = {chunk->data, STREAM_CHUNK_SIZE, 0};
+
+      while (out.pos < out.size && !done && error_code == OK) {
+        if (in.pos == in.size) {
+          in.size = fread(input, 1, sizeof(input), reader->file);
+          in.pos = 0;
+          if (in.size == 0) {
+            done = 1;
+            if (ferror(reader->file) || frame_left != 0) {
+              set_model_error(&reader->error, MODEL_ERROR_TRUNCATED, 0,
+                              "Truncated or unreadable zstd stream");
+              error_code = ERROR;
+            }
+          }
+        }
+        if (!done) {
+          frame_left = ZSTD_decompressStream(zs, &out, &in);
+          if (ZSTD_isError(frame_left)) {
+            set_model_error(&reader->error, MODEL_ERROR_FORMAT, 0,
+                            "Corrupted zstd stream");
+            error_code = ERROR;
+          }
+        }
+      }
+
+      chunk->size = out.pos;
+      stream_commit(reader);
+    }
+  }
+
+  ZSTD_freeDStream(zs);
+  stream_finish(reader, error_code);
+  return NULL;
+}
+#endif
+
+int stream_open(StreamReader *reader, const char *filename,
+                Compression compression, ModelError *error) {
+  int error_code = OK;
+  void *(*worker)(void *) = NULL;
+
+  memset(reader, 0, sizeof(*reader));
+  reader->compression = compression;
+
+  if (compression == COMPRESSION_GZIP) {
+    worker = gzip_worker;
+  }
+#ifdef VIEWER_WITH_ZSTD
+  if (compression == COMPRESSION_ZSTD) {
+    worker = zstd_worker;
+  }
+#endif
+  if (worker == NULL) {
+    set_model_error(error, MODEL_ERROR_FORMAT, 0,
+                    "Unsupported compression format");
+    error_code = ERROR;
+  }
+
+  if (error_code == OK) {
+    reader->file = fopen(filename, "rb");
+    if (reader->file == NULL) {
+      set_model_error(error, MODEL_ERROR_OPEN, 0, "Could not open the file");
+      error_code = ERROR;
+    }
+  }
+
+  for (int i = 0; i < STREAM_CHUNK_COUNT && error_code == OK; i++) {
+    reader->chunks[i].data =
+        (char *)parser_allocation(STREAM_CHUNK_SIZE, "stream chunk", error);
+    if (reader->chunks[i].data == NULL) {
+      error_code = ERROR;
+    }
+  }
+
+  if (error_code == OK) {
+    pthread_mutex_init(&reader->mutex, NULL);
+    pthread_cond_init(&reader->not_empty, NULL);
+    pthread_cond_init(&reader->not_full, NULL);
+    if (pthread_create(&reader->thread, NULL, worker, reader) != 0) {
+      set_model_error(error, MODEL_ERROR_MEMORY, 0,
+                      "Failed to start decompression thread");
+      pthread_mutex_destroy(&reader->mutex);
+      pthread_cond_destroy(&reader->not_empty);
+      pthread_cond_destroy(&reader->not_full);
+      error_code = ERROR;
+    }
+  }
+
+  if (error_code == OK) {
+    memory_track(MEMORY_STREAM, STREAM_CHUNK_COUNT * STREAM_CHUNK_SIZE);
+  } else {
+    for (int i = 0; i < STREAM_CHUNK_COUNT; i++) {
+      free(reader->chunks[i].data);
+    }
+    if (reader->file) {
+      fclose(reader->file);
+    }
+    memset(reader, 0, sizeof(*reader));
+  }
+
+  return error_code;
+}
+
+void stream_close(StreamReader *reader) {
+  pthread_mutex_lock(&reader->mutex);
+  reader->cancelled = 1;
+  pthread_cond_broadcast(&reader->not_full);
+  pthread_mutex_unlock(&reader->mutex);
+  pthread_join(reader->thread, NULL);
+
+  pthread_mutex_destroy(&reader->mutex);
+  pthread_cond_destroy(&reader->not_empty);
+  pthread_cond_destroy(&reader->not_full);
+  for (int i = 0; i < STREAM_CHUNK_COUNT; i++) {
+    free(reader->chunks[i].data);
+  }
+  memory_track(MEMORY_STREAM, -(long long)STREAM_CHUNK_COUNT * STREAM_CHUNK_SIZE);
+  fclose(reader->file);
+  memset(reader, 0, sizeof(*reader));
+}
+
+// Consumer side: the head chunk stays owned by the parser until it is drained,
+// so only chunk hand-over takes the lock, not every line.
+static StreamChunk *stream_acquire_filled(StreamReader *reader) {
+  StreamChunk *chunk = NULL;
+
+  pthread_mutex_lock(&reader->mutex);
+  while (reader->filled == 0 && !reader->finished) {
+    pthread_cond_wait(&reader->not_empty, &reader->mutex);
+  }
+  if (reader->filled > 0) {
+    chunk = &reader->chunks[reader->head];
+  }
+  pthread_mutex_unlock(&reader->mutex);
+
+  return chunk;
+}
+
+static void stream_release(StreamReader *reader) {
+  pthread_mutex_lock(&reader->mutex);
+  reader->head = (reader->head + 1) % STREAM_CHUNK_COUNT;
+  reader->filled -= 1;
+  reader->current = NULL;
+  reader->position = 0;
+  pthread_cond_signal(&reader->not_full);
+  pthread_mutex_unlock(&reader->mutex);
+}
+
+void stream_read_line(StreamReader *reader, char **line) {
+  size_t length = 0;
+  int has_data = 0;
+  int done = 0;
+
+  while (!done) {
+    if (reader->current == NULL) {
+      reader->current = stream_acquire_filled(reader);
+    }
+    StreamChunk *chunk = reader->current;
+    if (chunk == NULL) {
+      done = 1;
+    } else {
+      const char *start = chunk->data + reader->position;
+      size_t available = chunk->size - reader->position;
+      size_t room = MAX_LINE_LENGTH - 1 - length;
+      const char *newline = memchr(start, '\n', available);
+      size_t count = newline ? (size_t)(newline - start) : available;
+
+      if (count >= room) {
+        // Overlong lines are split the same way fgets splits them.
+        count = room;
+        newline = NULL;
+        done = 1;
+      }
+      memcpy(*line + length, start, count);
+      length += count;
+      reader->position += count;
+      if (count > 0) {
+        has_data = 1;
+      }
+
+      if (newline) {
+        reader->position += 1;
+        has_data = 1;
+        done = 1;
+      }
+      if (reader->position == chunk->size) {
+        stream_release(reader);
+      }
+    }
+  }
+
+  if (has_data) {
+    (*line)[length] = '\0';
+  } else {
+    *line = NULL;
+  }
+}
+
+int parse_stream(StreamReader *reader, char *line, ParseContext *context) {
+  int error_code = OK;
+  Model1 *model = context->model;
+  unsigned int vertex_capacity = 0;
+  unsigned int polygon_capacity = 0;
+
+  init_bounds(model);
+  stream_read_line(reader, &line);
+
+  while (line && error_code == OK) {
+    context->line += 1;
+    if (line[0] == 'v' && line[1] == ' ') {
+      error_code = reserve_buffer((void **)&model->vertices, &vertex_capacity,
+                                  context->vertex_index + 3, sizeof(double),
+                                  context->error);
+      if (error_code == OK) {
+        error_code = parse_vertices(context, line);
+      }
+    } else if (line[0] == 'v' && line[1] == 'n' && line[2] == ' ') {
+      error_code = parse_normals(context, line);
+    } else if (line[0] == 'f' && line[1] == ' ') {
+      // A face line cannot hold more indices than half its length, so
+      // parse_faces never has to fall back to its linear growth.
+      unsigned int max_indices = strlen(line) / 2 + 1;
+      error_code = reserve_buffer((void **)&model->faces,
+                                  &context->face_capacity,
+                                  context->face_index + max_indices,
+                                  sizeof(unsigned int), context->error);
+      if (error_code == OK) {
+        error_code = reserve_buffer((void **)&model->polygon_offsets,
+                                    &polygon_capacity,
+                                    context->polygon_index + 2,
+                                    sizeof(unsigned int), context->error);
+      }
+      if (error_code == OK) {
+        error_code = parse_faces(context, line);
+      }
+    }
+    if (error_code == OK) {
+      size_t model_bytes = sizeof(double) * vertex_capacity +
+                           sizeof(unsigned int) * polygon_capacity +
+                           sizeof(unsigned int) * context->face_capacity +
+                           sizeof(float) * context->normal_capacity;
+      if (model_bytes != model->memory_bytes) {
+        // The stream has no first pass, so the budget is checked whenever a
+        // buffer grows.
+        if (model_bytes > model->memory_bytes &&
+            !memory_budget_allows(model_bytes - model->memory_bytes)) {
+          set_model_error(context->error, MODEL_ERROR_BUDGET, context->line,
+                          "Model exceeds the memory budget of %.1f MB",
+                          get_memory_budget() / MEGABYTE);
+          error_code = ERROR;
+        }
+        update_model_memory(model, model_bytes);
+      }
+    }
+    if (error_code == OK) {
+      stream_read_line(reader, &line);
+    }
+  }
+
+  if (error_code == OK && reader->error_code != OK) {
+    set_model_error(context->error, reader->error.code, 0, "%s",
+                    reader->error.message);
+    error_code = ERROR;
+  }
+
+  if (error_code == OK) {
+    error_code = check_memory_budget(
+        "Model", 0, context->vertex_index / 3, context->face_index,
+        &model->float_vertices, context->error);
+  }
+
+  if (error_code == OK) {
+    model->vertex_count = context->vertex_index / 3;
+    model->face_count = context->face_index;
+    model->polygon_count = context->polygon_index;
+    model->normal_count = context->normal_index / 3;
+    compact_polygons(model);
+    if (model->polygon_offsets == NULL) {
+      update_model_memory(model, model->memory_bytes -
+                                     sizeof(unsigned int) * polygon_capacity);
+    }
+  }
+
+  return error_code;
+}
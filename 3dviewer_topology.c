@@ -0,0 +1,432 @@
+#include <stdatomic.h>
+
+#include "3dviewer.h"
+
+typedef struct topology_job {
+  const Model1 *model;
+  Topology *topology;
+  unsigned int *bucket_start;
+  atomic_uint *bucket_fill;
+  atomic_uint *parent;
+  unsigned int *sorted;
+  atomic_int error;
+  unsigned int edges[PARALLEL_MAX_WORKERS];
+  unsigned int boundary[PARALLEL_MAX_WORKERS];
+  unsigned int non_manifold[PARALLEL_MAX_WORKERS];
+} TopologyJob;
+
+unsigned int topology_next(const Topology *topology, unsigned int half_edge) {
+  unsigned int polygon = topology->polygon[half_edge];
+  return half_edge + 1 < topology->polygon_start[polygon + 1]
+             ? half_edge + 1
+             : topology->polygon_start[polygon];
+}
+
+unsigned int topology_prev(const Topology *topology, unsigned int half_edge) {
+  unsigned int polygon = topology->polygon[half_edge];
+  return half_edge > topology->polygon_start[polygon]
+             ? half_edge - 1
+             : topology->polygon_start[polygon + 1] - 1;
+}
+
+unsigned int topology_destination(const Topology *topology,
+                                  unsigned int half_edge) {
+  return topology->origin[topology_next(topology, half_edge)];
+}
+
+int topology_is_closed(const Topology *topology) {
+  return topology->boundary_edge_count == 0 &&
+         topology->non_manifold_edge_count == 0;
+}
+
+static unsigned int find_root(atomic_uint *parent, unsigned int vertex) {
+  unsigned int next = atomic_load(&parent[vertex]);
+
+  // Path halving; a failed exchange only means another thread got there.
+  while (next != vertex) {
+    unsigned int grandparent = atomic_load(&parent[next]);
+    atomic_compare_exchange_weak(&parent[vertex], &next, grandparent);
+    vertex = next;
+    next = atomic_load(&parent[vertex]);
+  }
+
+  return vertex;
+}
+
+// Roots are always linked from the larger index to the smaller one, so
+// concurrent unions cannot form a cycle.
+static void unite(atomic_uint *parent, unsigned int a, unsigned int b) {
+  int done = 0;
+
+  while (!done) {
+    a = find_root(parent, a);
+    b = find_root(parent, b);
+    if (a == b) {
+      done = 1;
+    } else {
+      if (a < b) {
+        unsigned int swap = a;
+        a = b;
+        b = swap;
+      }
+      unsigned int expected = a;
+      done = atomic_compare_exchange_strong(&parent[a], &expected, b);
+    }
+  }
+}
+
+static void copy_polygon_starts(void *context, size_t begin, size_t end,
+                                unsigned int worker) {
+  TopologyJob *job = context;
+  (void)worker;
+
+  for (size_t p = begin; p < end; p++) {
+    job->topology->polygon_start[p] = polygon_start(job->model, p);
+  }
+}
+
+static void link_half_edges(void *context, size_t begin, size_t end,
+                            unsigned int worker) {
+  TopologyJob *job = context;
+  Topology *topology = job->topology;
+  const unsigned int *faces = job->model->faces;
+  (void)worker;
+
+  for (size_t polygon = begin; polygon < end; polygon++) {
+    unsigned int first = topology->polygon_start[polygon];
+    unsigned int last = topology->polygon_start[polygon + 1];
+
+    for (unsigned int h = first; h < last; h++) {
+      unsigned int a = faces[h];
+      unsigned int b = faces[h + 1 < last ? h + 1 : first];
+
+      if (a == 0 || a > topology->vertex_count || b == 0 ||
+          b > topology->vertex_count) {
+        atomic_store(&job->error, ERROR);
+        topology->twin[h] = TOPOLOGY_DEGENERATE;
+      } else if (a == b) {
+        topology->twin[h] = TOPOLOGY_DEGENERATE;
+      } else {
+        topology->twin[h] = TOPOLOGY_NONE;
+        atomic_fetch_add_explicit(&job->bucket_fill[(a < b ? a : b) - 1], 1,
+                                  memory_order_relaxed);
+      }
+      topology->origin[h] = a - 1;
+      topology->polygon[h] = polygon;
+    }
+  }
+}
+
+static void copy_bucket_counts(void *context, size_t begin, size_t end,
+                               unsigned int worker) {
+  TopologyJob *job = context;
+  (void)worker;
+
+  for (size_t v = begin; v < end; v++) {
+    job->bucket_start[v] = atomic_load_explicit(&job->bucket_fill[v],
+                                                memory_order_relaxed);
+  }
+}
+
+static void reset_bucket_fill(void *context, size_t begin, size_t end,
+                              unsigned int worker) {
+  TopologyJob *job = context;
+  (void)worker;
+
+  for (size_t v = begin; v < end; v++) {
+    atomic_store_explicit(&job->bucket_fill[v], job->bucket_start[v],
+                          memory_order_relaxed);
+    atomic_store_explicit(&job->parent[v], v, memory_order_relaxed);
+  }
+}
+
+// Counting sort of the half-edges by their smaller vertex.
+static void scatter_half_edges(void *context, size_t begin, size_t end,
+                               unsigned int worker) {
+  TopologyJob *job = context;
+  Topology *topology = job->topology;
+  (void)worker;
+
+  for (size_t h = begin; h < end; h++) {
+    if (topology->twin[h] == TOPOLOGY_NONE) {
+      unsigned int a = topology->origin[h];
+      unsigned int b = topology_destination(topology, h);
+      unsigned int slot = atomic_fetch_add_explicit(
+          &job->bucket_fill[a < b ? a : b], 1, memory_order_relaxed);
+      job->sorted[slot] = h;
+    }
+  }
+}
+
+static int compare_keys(const void *left, const void *right) {
+  uint64_t a = *(const uint64_t *)left;
+  uint64_t b = *(const uint64_t *)right;
+  return (a > b) - (a < b);
+}
+
+// Sorts one bucket by (other vertex, half-edge) so that the copies of an
+// edge end up next to each other in a deterministic order.
+static void sort_bucket(const Topology *topology, unsigned int vertex,
+                        unsigned int *bucket, unsigned int size,
+                        uint64_t *keys) {
+  for (unsigned int i = 0; i < size; i++) {
+    unsigned int a = topology->origin[bucket[i]];
+    unsigned int other =
+        a == vertex ? topology_destination(topology, bucket[i]) : a;
+    keys[i] = (uint64_t)other << 32 | bucket[i];
+  }
+
+  if (size <= SMALL_BUCKET) {
+    for (unsigned int i = 1; i < size; i++) {
+      uint64_t key = keys[i];
+      unsigned int j = i;
+      for (; j > 0 && keys[j - 1] > key; j--) keys[j] = keys[j - 1];
+      keys[j] = key;
+    }
+  } else {
+    qsort(keys, size, sizeof(uint64_t), compare_keys);
+  }
+
+  for (unsigned int i = 0; i < size; i++) {
+    bucket[i] = (unsigned int)keys[i];
+  }
+}
+
+// Every run of equal (smaller, larger) vertex pairs is one edge: a single
+// half-edge is a boundary, two are twins, more make the edge non-manifold.
+static void pair_half_edges(void *context, size_t begin, size_t end,
+                            unsigned int worker) {
+  TopologyJob *job = context;
+  Topology *topology = job->topology;
+  uint64_t small_keys[SMALL_BUCKET];
+
+  for (size_t v = begin; v < end; v++) {
+    unsigned int *bucket = job->sorted + job->bucket_start[v];
+    unsigned int size = job->bucket_start[v + 1] - job->bucket_start[v];
+    uint64_t *keys = small_keys;
+
+    if (size > SMALL_BUCKET) {
+      keys = memory_allocation(sizeof(uint64_t) * size, "topology bucket");
+      if (keys == NULL) {
+        atomic_store(&job->error, ERROR);
+        size = 0;
+      }
+    }
+    sort_bucket(topology, v, bucket, size, keys);
+
+    for (unsigned int i = 0; i < size;) {
+      unsigned int other = keys[i] >> 32;
+      unsigned int run = 1;
+      while (i + run < size && keys[i + run] >> 32 == other) run++;
+
+      if (run == 1) {
+        topology->twin[bucket[i]] = TOPOLOGY_BOUNDARY;
+        job->boundary[worker]++;
+      } else if (run == 2) {
+        topology->twin[bucket[i]] = bucket[i + 1];
+        topology->twin[bucket[i + 1]] = bucket[i];
+      } else {
+        for (unsigned int j = 0; j < run; j++) {
+          topology->twin[bucket[i + j]] = TOPOLOGY_NON_MANIFOLD;
+        }
+        job->non_manifold[worker]++;
+      }
+      job->edges[worker]++;
+
+      atomic_fetch_add_explicit(&job->bucket_fill[v], 1, memory_order_relaxed);
+      atomic_fetch_add_explicit(&job->bucket_fill[other], 1,
+                                memory_order_relaxed);
+      unite(job->parent, v, other);
+      i += run;
+    }
+
+    if (keys != small_keys) free(keys);
+  }
+}
+
+static void reset_valence(void *context, size_t begin, size_t end,
+                          unsigned int worker) {
+  TopologyJob *job = context;
+  (void)worker;
+
+  for (size_t v = begin; v < end; v++) {
+    atomic_store_explicit(&job->bucket_fill[v], 0, memory_order_relaxed);
+  }
+}
+
+// Marks the roots of used vertices so that a scan numbers the components.
+static void mark_roots(void *context, size_t begin, size_t end,
+                       unsigned int worker) {
+  TopologyJob *job = context;
+  Topology *topology = job->topology;
+  (void)worker;
+
+  for (size_t v = begin; v < end; v++) {
+    topology->valence[v] =
+        atomic_load_explicit(&job->bucket_fill[v], memory_order_relaxed);
+    job->bucket_start[v] =
+        topology->valence[v] > 0 && find_root(job->parent, v) == v;
+  }
+}
+
+static void label_components(void *context, size_t begin, size_t end,
+                             unsigned int worker) {
+  TopologyJob *job = context;
+  Topology *topology = job->topology;
+  (void)worker;
+
+  for (size_t v = begin; v < end; v++) {
+    topology->component[v] =
+        topology->valence[v] > 0
+            ? job->bucket_start[find_root(job->parent, v)]
+            : TOPOLOGY_NONE;
+  }
+}
+
+static int allocate_topology(const Model1 *model, Topology *topology,
+                             TopologyJob *job, ModelError *error) {
+  int error_code = OK;
+  size_t half_edges = model->face_count;
+  size_t vertices = model->vertex_count;
+  size_t topology_bytes =
+      sizeof(unsigned int) * (3 * half_edges + model->polygon_count + 1 +
+                              2 * vertices);
+  size_t scratch_bytes =
+      sizeof(unsigned int) * (half_edges + 3 * vertices + 1);
+
+  if (!memory_budget_allows(topology_bytes + scratch_bytes)) {
+    set_model_error(error, MODEL_ERROR_BUDGET, 0,
+                    "Topology needs %.1f MB, memory budget is %.1f MB",
+                    (topology_bytes + scratch_bytes) / MEGABYTE,
+                    get_memory_budget() / MEGABYTE);
+    error_code = ERROR;
+  } else {
+    topology->origin = memory_allocation(sizeof(unsigned int) * half_edges,
+                                         "topology.origin");
+    topology->twin = memory_allocation(sizeof(unsigned int) * half_edges,
+                                       "topology.twin");
+    topology->polygon = memory_allocation(sizeof(unsigned int) * half_edges,
+                                          "topology.polygon");
+    topology->polygon_start = memory_allocation(
+        sizeof(unsigned int) * (model->polygon_count + 1),
+        "topology.polygon_start");
+    topology->valence = memory_allocation(sizeof(unsigned int) * vertices,
+                                          "topology.valence");
+    topology->component = memory_allocation(sizeof(unsigned int) * vertices,
+                                            "topology.component");
+    job->sorted = memory_allocation(sizeof(unsigned int) * half_edges,
+                                    "topology buckets");
+    job->bucket_start = memory_allocation(
+        sizeof(unsigned int) * (vertices + 1), "topology buckets");
+    job->bucket_fill =
+        memory_allocation(sizeof(atomic_uint) * vertices, "topology buckets");
+    job->parent =
+        memory_allocation(sizeof(atomic_uint) * vertices, "topology.parent");
+
+    if ((half_edges &&
+         (!topology->origin || !topology->twin || !topology->polygon ||
+          !job->sorted)) ||
+        (vertices && (!topology->valence || !topology->component ||
+                      !job->bucket_fill || !job->parent)) ||
+        !topology->polygon_start || !job->bucket_start) {
+      set_model_error(error, MODEL_ERROR_MEMORY, 0,
+                      "Not enough memory for the model topology");
+      error_code = ERROR;
+    }
+  }
+
+  if (error_code == OK) {
+    topology->memory_bytes = topology_bytes;
+    memory_track(MEMORY_TOPOLOGY, topology_bytes + scratch_bytes);
+  }
+  return error_code;
+}
+
+int build_topology(const Model1 *model, Topology *topology,
+                   ModelError *error) {
+  int error_code = OK;
+  TopologyJob job = {0};
+
+  memset(topology, 0, sizeof(Topology));
+  clear_model_error(error);
+  topology->vertex_count = model->vertex_count;
+  topology->polygon_count = model->polygon_count;
+  topology->half_edge_count = model->face_count;
+  job.model = model;
+  job.topology = topology;
+  atomic_init(&job.error, OK);
+
+  error_code = allocate_topology(model, topology, &job, error);
+  size_t scratch_bytes = sizeof(unsigned int) *
+                         (model->face_count + 3 * model->vertex_count + 1);
+
+  if (error_code == OK) {
+    parallel_for(model->polygon_count + 1, PARALLEL_GRAIN, copy_polygon_starts,
+                 &job);
+  }
+  if (error_code == OK &&
+      topology->polygon_start[model->polygon_count] != model->face_count) {
+    error_code = ERROR;
+  }
+
+  if (error_code == OK) {
+    parallel_for(model->vertex_count, PARALLEL_GRAIN, reset_valence, &job);
+    parallel_for(model->polygon_count, PARALLEL_GRAIN, link_half_edges, &job);
+    error_code = atomic_load(&job.error);
+  }
+
+  if (error_code == OK) {
+    parallel_for(model->vertex_count, PARALLEL_GRAIN, copy_bucket_counts,
+                 &job);
+    error_code = parallel_exclusive_scan(job.bucket_start, model->vertex_count);
+  }
+
+  if (error_code == OK) {
+    parallel_for(model->vertex_count, PARALLEL_GRAIN, reset_bucket_fill, &job);
+    parallel_for(model->face_count, PARALLEL_GRAIN, scatter_half_edges, &job);
+    parallel_for(model->vertex_count, PARALLEL_GRAIN, reset_valence, &job);
+    parallel_for(model->vertex_count, PARALLEL_GRAIN, pair_half_edges, &job);
+    error_code = atomic_load(&job.error);
+  }
+
+  if (error_code == OK) {
+    parallel_for(model->vertex_count, PARALLEL_GRAIN, mark_roots, &job);
+    error_code = parallel_exclusive_scan(job.bucket_start, model->vertex_count);
+  }
+
+  if (error_code == OK) {
+    parallel_for(model->vertex_count, PARALLEL_GRAIN, label_components, &job);
+    topology->component_count = job.bucket_start[model->vertex_count];
+    for (int i = 0; i < PARALLEL_MAX_WORKERS; i++) {
+      topology->edge_count += job.edges[i];
+      topology->boundary_edge_count += job.boundary[i];
+      topology->non_manifold_edge_count += job.non_manifold[i];
+    }
+  }
+
+  if (topology->memory_bytes) {
+    memory_track(MEMORY_TOPOLOGY, -(long long)scratch_bytes);
+  }
+  free(job.sorted);
+  free(job.bucket_start);
+  free(job.bucket_fill);
+  free(job.parent);
+
+  if (error_code != OK) {
+    set_model_error(error, MODEL_ERROR_FORMAT, 0,
+                    "Could not build the model topology");
+    free_topology(topology);
+  }
+  return error_code;
+}
+
+void free_topology(Topology *topology) {
+  memory_track(MEMORY_TOPOLOGY, -(long long)topology->memory_bytes);
+  free(topology->origin);
+  free(topology->twin);
+  free(topology->polygon);
+  free(topology->polygon_start);
+  free(topology->valence);
+  free(topology->component);
+  memset(topology, 0, sizeof(Topology));
+}
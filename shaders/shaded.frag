@@ -0,0 +1,9 @@
+#version 330 core
+in vec3 viewNormal;
+out vec4 FragColor;
+uniform vec4 surfaceColor;
+
+void main() {
+  float light = abs(normalize(viewNormal).z);
+  FragColor = vec4(surfaceColor.rgb * (0.25 + 0.75 * light), surfaceColor.a);
+}
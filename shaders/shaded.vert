@@ -0,0 +1,13 @@
+#version 330 core
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+uniform mat4 mvp;
+uniform mat4 view;
+uniform vec4 clipPlane;
+out vec3 viewNormal;
+
+void main() {
+  gl_Position = mvp * vec4(position, 1.0);
+  gl_ClipDistance[0] = dot(clipPlane, vec4(position, 1.0));
+  viewNormal = mat3(view) * normal;
+}
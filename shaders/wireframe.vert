@@ -0,0 +1,9 @@
+#version 330 core
+layout(location = 0) in vec3 position;
+uniform mat4 mvp;
+uniform vec4 clipPlane;
+
+void main() {
+  gl_Position = mvp * vec4(position, 1.0);
+  gl_ClipDistance[0] = dot(clipPlane, vec4(position, 1.0));
+}